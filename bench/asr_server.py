@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+"""
+Stand-in ASR server of the tcp://, unix:// and udp:// transports, to run respeaker_core without a real ASR server.
+It replies with a partial every 10 audio frames and with a final transcribe to each {"eof" : 1}.
+
+Usage: asr_server.py tcp PORT | unix PATH | udp PORT
+"""
+import json
+import os
+import socket
+import stat
+import struct
+import sys
+
+FINAL = json.dumps({"result": [{"conf": 1.0, "end": 1.02, "start": 0.66, "word": "hello"},
+                               {"conf": 0.5, "end": 1.5, "start": 1.02, "word": "world"}], "text": "hello world"})
+BINARY, TEXT = 1, 2
+
+
+def reply(frames, text):
+    """Replies to a message: a partial every 10 audio frames, a final transcribe to EOF, None otherwise."""
+    if text is None:
+        return json.dumps({"partial": "hello"}) if frames % 10 == 5 else None
+    if "eof" in text:
+        print("server: %d audio frames, then EOF" % frames, flush=True)
+        return FINAL
+    # The UDP client waits for any answer to its hello before it considers the server up.
+    if "hello" in text:
+        return "{}"
+    print("server: " + text, flush=True)
+    return None
+
+
+def serve_stream(server):
+    def frame(text):
+        payload = text.encode()
+        return struct.pack("<IB", len(payload) + 1, TEXT) + payload
+
+    while True:
+        client, _ = server.accept()
+        buffer, frames = b"", 0
+        while True:
+            data = client.recv(65536)
+            if not data:
+                break
+            buffer += data
+            while len(buffer) >= 5:
+                length, kind = struct.unpack("<IB", buffer[:5])
+                if len(buffer) < 4 + length:
+                    break
+                payload, buffer = buffer[5:4 + length], buffer[4 + length:]
+                frames += kind == BINARY
+                answer = reply(frames, payload.decode() if kind == TEXT else None)
+                if answer:
+                    client.sendall(frame(answer))
+        client.close()
+
+
+def serve_datagrams(server):
+    frames = 0
+    while True:
+        datagram, peer = server.recvfrom(70000)
+        frames += datagram[0] == BINARY
+        answer = reply(frames, datagram[1:].decode() if datagram[0] == TEXT else None)
+        if answer:
+            server.sendto(bytes([TEXT]) + answer.encode(), peer)
+        if answer == FINAL:
+            frames = 0
+
+
+def main():
+    if len(sys.argv) != 3 or sys.argv[1] not in ("tcp", "unix", "udp"):
+        sys.exit(__doc__.strip())
+    scheme, address = sys.argv[1:]
+
+    if scheme == "unix":
+        if os.path.exists(address) and stat.S_ISSOCK(os.lstat(address).st_mode):
+            os.unlink(address)
+        server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        server.bind(address)
+    else:
+        server = socket.socket(socket.AF_INET, socket.SOCK_DGRAM if scheme == "udp" else socket.SOCK_STREAM)
+        server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        server.bind(("127.0.0.1", int(address)))
+
+    if scheme == "udp":
+        serve_datagrams(server)
+    else:
+        server.listen(1)
+        serve_stream(server)
+
+
+if __name__ == "__main__":
+    try:
+        main()
+    except KeyboardInterrupt:
+        pass
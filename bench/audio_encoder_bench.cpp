@@ -0,0 +1,86 @@
+/**
+ * Audio encoder benchmark: CPU time per 8 ms block and compression ratio of each codec the build supports (Opus with libopus),
+ * on a synthetic voice-like signal (a few harmonics of a gliding pitch over a little noise).
+ *
+ * Usage: audio_encoder_bench [rate = 16000] [blocks = 20000]
+ */
+#include "audio_encoder.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+#define BENCH_BLOCK_MS 8
+#define BENCH_BITRATE 16000
+
+using namespace std;
+
+static string synthesize(int rate, int blocks)
+{
+  size_t samples = (size_t)rate * BENCH_BLOCK_MS / 1000 * blocks;
+  string pcm(samples * sizeof(int16_t), '\0');
+  int16_t *data = (int16_t *)&pcm[0];
+  mt19937 random(1);
+  normal_distribution<double> noise(0, 300);
+  double phase = 0;
+
+  for (size_t i = 0; i < samples; i++)
+  {
+    double pitch = 120 + 40 * sin(2 * M_PI * i / rate);
+    phase += 2 * M_PI * pitch / rate;
+    double value = 0;
+    for (int harmonic = 1; harmonic <= 8; harmonic++)
+    {
+      value += 3000.0 / harmonic * sin(harmonic * phase);
+    }
+    data[i] = (int16_t)max(-32768.0, min(32767.0, value + noise(random)));
+  }
+  return pcm;
+}
+
+int main(int argc, char **argv)
+{
+  int rate = argc > 1 ? atoi(argv[1]) : 16000;
+  int blocks = argc > 2 ? atoi(argv[2]) : 20000;
+  if (rate < 1000 || blocks <= 0)
+  {
+    fprintf(stderr, "Usage: %s [rate] [blocks]\n", argv[0]);
+    return 1;
+  }
+
+  string pcm = synthesize(rate, blocks);
+  size_t blockBytes = pcm.size() / blocks;
+
+#ifdef WITH_OPUS
+  const char *codecs[] = {"adpcm", "opus"};
+#else
+  const char *codecs[] = {"adpcm"};
+#endif
+  for (const char *codec : codecs)
+  {
+    // Opus takes only a few rates.
+    unique_ptr<AudioEncoder> encoder = createAudioEncoder(codec, rate, 1, BENCH_BITRATE);
+    if (encoder == nullptr)
+    {
+      continue;
+    }
+
+    string block, encoded;
+    size_t outputBytes = 0;
+    chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+    for (int i = 0; i < blocks; i++)
+    {
+      block.assign(pcm, i * blockBytes, blockBytes);
+      encoder->encode(block, encoded);
+      outputBytes += encoded.size();
+    }
+    encoder->flush(encoded);
+    outputBytes += encoded.size();
+    double micros = chrono::duration<double, micro>(chrono::steady_clock::now() - startTime).count();
+
+    printf("%-6s %d Hz: %6.2f us/block, %.1fx smaller than PCM\n", codec, rate, micros / blocks, (double)pcm.size() / outputBytes);
+  }
+  return 0;
+}
@@ -0,0 +1,131 @@
+/**
+ * Audio queue benchmark: blocks handed from a producer thread to a consumer thread through AudioQueue, either copied into
+ * the slots (the view overload, as every block was before the move path) or moved in, with the block returned by value
+ * (librespeaker) or filled in place (file source). Copies are counted by the queue, allocations by the replaced operator new.
+ *
+ * Usage: audio_queue_bench [block bytes = 256] [blocks = 2000000]
+ */
+#include "audio_queue.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+
+#define BENCH_QUEUE_DEPTH 64
+
+using namespace std;
+
+static atomic<uint64_t> allocations(0);
+
+void *operator new(size_t size)
+{
+  allocations.fetch_add(1, memory_order_relaxed);
+  void *pointer = malloc(size ? size : 1);
+  if (pointer == nullptr)
+  {
+    throw bad_alloc();
+  }
+  return pointer;
+}
+
+void operator delete(void *pointer) noexcept
+{
+  free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+  free(pointer);
+}
+
+enum class Producer
+{
+  Copy,
+  MoveByValue,
+  MoveInPlace
+};
+
+/**
+ * Stand-in of librespeaker's DetectHotword: every block is a new string.
+ */
+static string processByValue(size_t blockBytes, int i)
+{
+  return string(blockBytes, (char)i);
+}
+
+static void measure(const char *name, Producer producer, size_t blockBytes, int blocks)
+{
+  AudioQueue queue(BENCH_QUEUE_DEPTH, OverflowPolicy::Block, blockBytes);
+  atomic<uint64_t> checksum(0);
+
+  thread consumer([&]() {
+    AudioChunk chunk;
+    chunk.data.reserve(blockBytes);
+    uint64_t sum = 0;
+    for (int received = 0; received < blocks;)
+    {
+      if (queue.waitPop(chunk, chrono::milliseconds(QUEUE_WAIT_TIMEOUT)))
+      {
+        sum += (uint8_t)chunk.data[0];
+        received++;
+      }
+    }
+    checksum = sum;
+  });
+
+  AudioChunk chunk;
+  chunk.data.reserve(blockBytes);
+  uint64_t startAllocations = allocations.load();
+  chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+  for (int i = 0; i < blocks; i++)
+  {
+    if (producer == Producer::Copy)
+    {
+      string block = processByValue(blockBytes, i);
+      queue.push(AudioView{block.data(), block.size()});
+    }
+    else
+    {
+      if (producer == Producer::MoveByValue)
+      {
+        chunk.data = processByValue(blockBytes, i);
+      }
+      else
+      {
+        chunk.data.assign(blockBytes, (char)i);
+      }
+      chunk.captureTime = SteadyClock::now();
+      queue.push(move(chunk));
+    }
+  }
+
+  consumer.join();
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+  // The consumer thread allocates nothing once started, so the difference is the producer's and the queue's.
+  double allocationsPerBlock = (double)(allocations.load() - startAllocations) / blocks;
+  AudioQueueStats stats = queue.stats();
+
+  printf("%-22s %5zu B/block: %6.2fM blocks/s, %.2f copies/block, %.2f allocations/block (checksum %llu)\n", name, blockBytes,
+         blocks / seconds / 1e6, (double)stats.copied / blocks, allocationsPerBlock, (unsigned long long)checksum.load());
+}
+
+int main(int argc, char **argv)
+{
+  size_t blockBytes = argc > 1 ? atoi(argv[1]) : 256;
+  int blocks = argc > 2 ? atoi(argv[2]) : 2000000;
+  if (blockBytes == 0 || blocks <= 0)
+  {
+    fprintf(stderr, "Usage: %s [block bytes] [blocks]\n", argv[0]);
+    return 1;
+  }
+
+  measure("copy into slot", Producer::Copy, blockBytes, blocks);
+  measure("move, DSP by value", Producer::MoveByValue, blockBytes, blocks);
+  measure("move, filled in place", Producer::MoveInPlace, blockBytes, blocks);
+  return 0;
+}
@@ -0,0 +1,136 @@
+/**
+ * LED fade benchmark: a frame of a whole-ring fade rendered the way animations used to (every pixel scaled with remap_4byte)
+ * against a gamma-corrected LUT lookup written with cAPA102_Fill_4byte, both refreshed into the null backend.
+ *
+ * Usage: led_lut_bench [LEDs = 12] [fade cycles = 1000000]
+ */
+extern "C"
+{
+#include "cAPA102.h"
+#include "animation.h"
+}
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#define BENCH_COLOUR 0x800080
+#define BENCH_MAX_BRIGHTNESS 255
+
+using namespace std;
+using SteadyClock = chrono::steady_clock;
+
+/**
+ * Removed from animation.c together with the per-pixel fades, kept here as the baseline.
+ */
+static uint32_t remap_4byte(uint32_t color, uint8_t brightness)
+{
+  uint8_t r, g, b;
+
+  r = (uint8_t)((color >> 16) * brightness / 255);
+  g = (uint8_t)((color >> 8) * brightness / 255);
+  b = (uint8_t)(color * brightness / 255);
+
+  return (r << 16) | (g << 8) | b;
+}
+
+/**
+ * Same table as animation.c builds for each configured colour.
+ */
+static void buildLut(uint32_t *lut, uint32_t colour)
+{
+  for (int level = 0; level < LUT_SIZE; level++)
+  {
+    double scale = pow((double)level / (LUT_SIZE - 1), GAMMA) * BENCH_MAX_BRIGHTNESS / 255;
+    uint8_t r = (uint8_t)(((colour >> 16) & 0xFF) * scale + 0.5);
+    uint8_t g = (uint8_t)(((colour >> 8) & 0xFF) * scale + 0.5);
+    uint8_t b = (uint8_t)((colour & 0xFF) * scale + 0.5);
+    lut[level] = (r << 16) | (g << 8) | b;
+  }
+}
+
+/**
+ * Old fade: brightness goes up and down by a twentieth of the maximum, every pixel is remapped on each frame.
+ */
+static long fadeRemap(int leds, int cycles)
+{
+  int step = BENCH_MAX_BRIGHTNESS / STEP_COUNT;
+  long frames = 0;
+  for (int i = 0; i < cycles; i++)
+  {
+    for (int brightness = 0; brightness < BENCH_MAX_BRIGHTNESS; brightness += step, frames++)
+    {
+      for (int j = 0; j < leds; j++)
+      {
+        cAPA102_Set_Pixel_4byte(j, remap_4byte(BENCH_COLOUR, brightness));
+      }
+      cAPA102_Refresh();
+    }
+    for (int brightness = BENCH_MAX_BRIGHTNESS; brightness > 0; brightness -= step, frames++)
+    {
+      for (int j = 0; j < leds; j++)
+      {
+        cAPA102_Set_Pixel_4byte(j, remap_4byte(BENCH_COLOUR, brightness));
+      }
+      cAPA102_Refresh();
+    }
+  }
+  return frames;
+}
+
+/**
+ * Current fade: perceptual levels are looked up in the colour's LUT, the whole ring is filled at once.
+ */
+static long fadeLut(const uint32_t *lut, int cycles)
+{
+  int step = (LUT_SIZE - 1) / STEP_COUNT;
+  long frames = 0;
+  for (int i = 0; i < cycles; i++)
+  {
+    for (int level = 0; level < LUT_SIZE - 1; level += step, frames++)
+    {
+      cAPA102_Fill_4byte(lut[level]);
+      cAPA102_Refresh();
+    }
+    for (int level = LUT_SIZE - 1; level > 0; level -= step, frames++)
+    {
+      cAPA102_Fill_4byte(lut[level]);
+      cAPA102_Refresh();
+    }
+  }
+  return frames;
+}
+
+int main(int argc, char **argv)
+{
+  int leds = argc > 1 ? atoi(argv[1]) : 12;
+  int cycles = argc > 2 ? atoi(argv[2]) : 1000000;
+  if (leds <= 0 || cycles <= 0)
+  {
+    fprintf(stderr, "Usage: %s [LEDs] [fade cycles]\n", argv[0]);
+    return 1;
+  }
+
+  cAPA102_Set_Backend(cAPA102_NULL, nullptr);
+  if (cAPA102_Init(leds, 0, 0, 31) != 0)
+  {
+    fprintf(stderr, "Unable to set up the null LED backend\n");
+    return 1;
+  }
+
+  static uint32_t lut[LUT_SIZE];
+  buildLut(lut, BENCH_COLOUR);
+
+  SteadyClock::time_point startTime = SteadyClock::now();
+  long frames = fadeRemap(leds, cycles);
+  double remapNs = chrono::duration<double, nano>(SteadyClock::now() - startTime).count() / frames;
+
+  startTime = SteadyClock::now();
+  frames = fadeLut(lut, cycles);
+  double lutNs = chrono::duration<double, nano>(SteadyClock::now() - startTime).count() / frames;
+
+  printf("%d LEDs: remap_4byte per pixel %.1f ns/frame, LUT fill %.1f ns/frame, %.2fx\n", leds, remapNs, lutNs, remapNs / lutNs);
+  cAPA102_Close();
+  return 0;
+}
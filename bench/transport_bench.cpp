@@ -0,0 +1,247 @@
+/**
+ * ASR transport benchmark: streams audio blocks to a stand-in server on loopback over each transport and reports
+ * the sender thread's CPU time per block and the round trip of a block to the server's reply.
+ *
+ * Usage: transport_bench [block bytes = 256] [blocks = 20000]
+ */
+#include "transport.hpp"
+
+#include <ixwebsocket/IXWebSocketServer.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#define BENCH_PORT 28000
+#define BENCH_SOCKET "/tmp/transport_bench.sock"
+#define BENCH_PINGS 2000
+#define BENCH_REPLY_TIMEOUT 1000
+// A block which starts with it asks the server to reply, the rest are only consumed.
+#define BENCH_PING_MARK 'A'
+
+using namespace std;
+using SteadyClock = chrono::steady_clock;
+
+static double threadCpuMicros()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+static bool receiveAll(int fd, char *buffer, size_t size)
+{
+  while (size > 0)
+  {
+    ssize_t received = recv(fd, buffer, size, 0);
+    if (received <= 0)
+    {
+      return false;
+    }
+    buffer += received;
+    size -= received;
+  }
+  return true;
+}
+
+/**
+ * Stand-in server of the length-prefixed TCP / Unix socket protocol: one client, until it disconnects.
+ */
+static void serveStream(int listenFd)
+{
+  int client = accept(listenFd, nullptr, nullptr);
+  vector<char> payload(1 << 20);
+  char header[5];
+  const char reply[] = {3, 0, 0, 0, 2, '{', '}'};
+
+  while (client != -1 && receiveAll(client, header, sizeof(header)))
+  {
+    uint32_t length = (uint8_t)header[0] | (uint8_t)header[1] << 8 | (uint8_t)header[2] << 16 | (uint32_t)(uint8_t)header[3] << 24;
+    if (length == 0 || length - 1 > payload.size() || !receiveAll(client, payload.data(), length - 1))
+    {
+      break;
+    }
+    if (header[4] == 1 && length > 1 && payload[0] == BENCH_PING_MARK)
+    {
+      send(client, reply, sizeof(reply), MSG_NOSIGNAL);
+    }
+  }
+  if (client != -1)
+  {
+    close(client);
+  }
+}
+
+/**
+ * Stand-in server of the UDP protocol: answers hellos and ping blocks, until stopped.
+ */
+static void serveDatagrams(int fd, atomic<bool> &isServing)
+{
+  vector<char> datagram(70000);
+  const char reply[] = {2, '{', '}'};
+  struct timeval timeout = {0, 100000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  while (isServing)
+  {
+    struct sockaddr_storage peer;
+    socklen_t peerSize = sizeof(peer);
+    ssize_t received = recvfrom(fd, datagram.data(), datagram.size(), 0, (struct sockaddr *)&peer, &peerSize);
+    if (received < 2)
+    {
+      continue;
+    }
+    if (datagram[0] == 2 || datagram[1] == BENCH_PING_MARK)
+    {
+      sendto(fd, reply, sizeof(reply), 0, (struct sockaddr *)&peer, peerSize);
+    }
+  }
+}
+
+static int listenOn(int family, int type)
+{
+  int fd = socket(family, type, 0);
+  int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  if (family == AF_UNIX)
+  {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, BENCH_SOCKET, sizeof(address.sun_path) - 1);
+    unlink(BENCH_SOCKET);
+    bind(fd, (struct sockaddr *)&address, sizeof(address));
+  }
+  else
+  {
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(BENCH_PORT);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(fd, (struct sockaddr *)&address, sizeof(address));
+  }
+  if (type == SOCK_STREAM)
+  {
+    listen(fd, 1);
+  }
+  return fd;
+}
+
+static void measure(const string &url, size_t blockBytes, int blocks)
+{
+  atomic<bool> isOpen(false), isReplied(false);
+  unique_ptr<Transport> transport = createTransport(url);
+  transport->setCallbacks([&]() { isOpen = true; }, []() {}, [&](const string &) { isReplied = true; });
+  transport->start();
+
+  SteadyClock::time_point startTime = SteadyClock::now();
+  while (!isOpen && SteadyClock::now() - startTime < chrono::seconds(5))
+  {
+    usleep(1000);
+  }
+  if (!isOpen)
+  {
+    printf("%-12s unable to connect to the stand-in server\n", transport->name().c_str());
+    transport->stop();
+    return;
+  }
+
+  // Sender thread's cost: what the ASR client pays per block, with a short pause now and then so that the server keeps up.
+  string block(blockBytes, 'x');
+  double startCpu = threadCpuMicros();
+  for (int i = 0; i < blocks; i++)
+  {
+    transport->sendBinary(block);
+    if (i % 64 == 0)
+    {
+      usleep(200);
+    }
+  }
+  double cpuPerBlock = (threadCpuMicros() - startCpu) / blocks;
+
+  // Round trip: a block is sent, the server's reply is delivered by the transport's receiver.
+  vector<double> roundTrips;
+  string ping(blockBytes, BENCH_PING_MARK);
+  for (int i = 0; i < BENCH_PINGS; i++)
+  {
+    isReplied = false;
+    SteadyClock::time_point sendTime = SteadyClock::now();
+    transport->sendBinary(ping);
+    while (!isReplied && SteadyClock::now() - sendTime < chrono::milliseconds(BENCH_REPLY_TIMEOUT))
+    {
+    }
+    roundTrips.push_back(chrono::duration<double, micro>(SteadyClock::now() - sendTime).count());
+    usleep(100);
+  }
+  sort(roundTrips.begin(), roundTrips.end());
+
+  printf("%-12s %5zu B/block: send CPU %6.2f us/block, round trip p50 %7.1f us, p99 %7.1f us\n", transport->name().c_str(), blockBytes,
+         cpuPerBlock, roundTrips[roundTrips.size() / 2], roundTrips[roundTrips.size() * 99 / 100]);
+  transport->stop();
+}
+
+int main(int argc, char **argv)
+{
+  size_t blockBytes = argc > 1 ? atoi(argv[1]) : 256;
+  int blocks = argc > 2 ? atoi(argv[2]) : 20000;
+  if (blockBytes == 0 || blocks <= 0)
+  {
+    fprintf(stderr, "Usage: %s [block bytes] [blocks]\n", argv[0]);
+    return 1;
+  }
+
+  // WebSocket: the app's IXWebSocket client against an IXWebSocket server, without compression as in the app.
+  {
+    ix::WebSocketServer server(BENCH_PORT, "127.0.0.1");
+    server.disablePerMessageDeflate();
+    server.setOnClientMessageCallback([](shared_ptr<ix::ConnectionState>, ix::WebSocket &client, const ix::WebSocketMessagePtr &msg) {
+      if (msg->type == ix::WebSocketMessageType::Message && msg->binary && !msg->str.empty() && msg->str[0] == BENCH_PING_MARK)
+      {
+        client.sendText("{}");
+      }
+    });
+    if (server.listen().first)
+    {
+      server.start();
+      measure("ws://127.0.0.1:" + to_string(BENCH_PORT), blockBytes, blocks);
+      server.stop();
+    }
+  }
+
+  const pair<string, int> streams[] = {{"tcp://127.0.0.1:" + to_string(BENCH_PORT), AF_INET}, {"unix://" BENCH_SOCKET, AF_UNIX}};
+  for (auto &stream : streams)
+  {
+    int listenFd = listenOn(stream.second, SOCK_STREAM);
+    thread server(serveStream, listenFd);
+    measure(stream.first, blockBytes, blocks);
+    // Wakes up the server if the client has never connected.
+    shutdown(listenFd, SHUT_RDWR);
+    server.join();
+    close(listenFd);
+  }
+  unlink(BENCH_SOCKET);
+
+  int datagramFd = listenOn(AF_INET, SOCK_DGRAM);
+  atomic<bool> isServing(true);
+  thread server(serveDatagrams, datagramFd, ref(isServing));
+  measure("udp://127.0.0.1:" + to_string(BENCH_PORT), blockBytes, blocks);
+  isServing = false;
+  server.join();
+  close(datagramFd);
+  return 0;
+}
@@ -5,16 +5,65 @@
 
 #define STEP_COUNT 20
 
-void *on_idle(void);
+/* Fade levels are perceptual: LED intensity follows level ^ GAMMA */
+#define LUT_SIZE 256
+#define GAMMA 2.2
 
-void *on_listen(void);
+/* Generator has rendered its last frame */
+#define ANIMATION_DONE -1
+/* Generator has nothing to render until the next state change */
+#define ANIMATION_WAIT -2
 
-void *on_speak(void);
+/* Progress of the running animation, reset on every state change */
+typedef struct
+{
+    int phase;
+    int level;
+    int fading_out;
+    uint8_t led;
+    uint8_t group;
+    const KEYFRAME_ANIMATION *keyframes;
+    double x;
+    double y;
+} ANIMATION_CTX;
 
-void *to_mute(void);
+/**
+ * @brief: Frame generator: render the next frame of an animation.
+ *
+ * @returns: Delay in ms before the next frame, ANIMATION_DONE or ANIMATION_WAIT
+ */
+typedef int (*ANIMATION)(ANIMATION_CTX *ctx);
 
-void *to_unmute(void);
+/**
+ * @brief: Precompute colours of every fade level for the configured colours and brightness.
+ */
+void build_colour_luts(void);
 
-void *on_disabled(void);
+int on_idle(ANIMATION_CTX *ctx);
+
+int on_listen(ANIMATION_CTX *ctx);
+
+int on_speak(ANIMATION_CTX *ctx);
+
+int to_mute(ANIMATION_CTX *ctx);
+
+int to_unmute(ANIMATION_CTX *ctx);
+
+int on_disabled(ANIMATION_CTX *ctx);
+
+/**
+ * @brief: Highlight LEDs nearest to the smoothed direction of arrival.
+ */
+int on_direction(ANIMATION_CTX *ctx);
+
+/**
+ * @brief: Play a compiled keyframe animation: a single frame copy per call.
+ */
+int play_keyframes(ANIMATION_CTX *ctx);
+
+/**
+ * @brief: Release a compiled keyframe animation, NULL is ignored.
+ */
+void free_keyframes(KEYFRAME_ANIMATION *keyframes);
 
 #endif
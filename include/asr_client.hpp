@@ -0,0 +1,176 @@
+#ifndef ASR_CLIENT_HPP
+#define ASR_CLIENT_HPP
+
+#define ASR_CONNECTION_TIMEOUT 5000
+#define ASR_EOF_MESSAGE "{\"eof\" : 1}"
+#define ASR_RECONNECT_POLL 20
+#define ASR_MAX_BACKOFF_SHIFT 16
+
+extern "C"
+{
+#include "verbose.h"
+}
+#include "json.hpp"
+#include "transport.hpp"
+#include "asr_response.hpp"
+#include "transcript_publisher.hpp"
+#include "audio_queue.hpp"
+#include "audio_encoder.hpp"
+#include "config.hpp"
+#include "latency_tracker.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <vector>
+#include <thread>
+
+using namespace std;
+using json = nlohmann::json;
+using SteadyClock = chrono::steady_clock;
+using TimePoint = chrono::time_point<SteadyClock>;
+
+struct EncoderStats
+{
+  string codec;
+  uint64_t blocks;
+  uint64_t inputBytes;
+  uint64_t outputBytes;
+  uint64_t encodeMicros;
+};
+
+struct FrameStats
+{
+  uint64_t frames;
+  uint64_t bytes;
+};
+
+struct ReconnectStats
+{
+  uint64_t reconnects;
+  uint64_t bufferedBytes;
+  uint64_t peakBufferedBytes;
+  uint64_t droppedUtterances;
+};
+
+/**
+ * Streams utterances to the ASR server over a transport picked by the address scheme, and takes transcripts back.
+ */
+class AsrClient
+{
+private:
+  unique_ptr<Transport> transport;
+  atomic<bool> _isConnected;
+
+  // Written by the transport's callback thread. The audio loop takes the pending event with an acquire exchange, which also publishes the time.
+  atomic<bool> _isTranscribeReceived;
+  atomic<bool> isTranscribePending;
+  atomic<int64_t> transcribeTime;
+
+  // Used by the transport's callback thread only.
+  AsrResponseParser responseParser;
+  AsrResponse response;
+  void handleOpen();
+  void handleClose();
+  void handleMessage(const string &message);
+
+  // Transcripts are streamed to local consumers, tagged with the utterance they belong to.
+  unique_ptr<TranscriptPublisher> publisher;
+  string lastPartial;
+  // Published by the sender thread when it takes the start of utterance marker, so that they follow the end of the previous one.
+  atomic<uint32_t> utteranceId;
+  atomic<int> utteranceDirection;
+  atomic<int> startDirection;
+  // Responses received before this many final results belong to the previous utterance and are dropped.
+  atomic<uint64_t> utteranceResultBase;
+  LatencyTracker *latencyTracker;
+
+  // Audio blocks are handed over to a dedicated sender thread, so a stalled socket never blocks the DSP chain.
+  AudioQueue queue;
+  thread sender;
+  atomic<bool> isSending;
+
+  // Optional compression stage, runs on the sender thread.
+  unique_ptr<AudioEncoder> encoder;
+  int rate;
+  void sendStreamConfig();
+  atomic<uint64_t> encodedBlocks;
+  atomic<uint64_t> encoderInputBytes;
+  atomic<uint64_t> encoderOutputBytes;
+  atomic<uint64_t> encodeMicros;
+
+  // Blocks are coalesced into bigger frames to save on framing and syscalls.
+  string frame;
+  size_t frameAudioBytes;
+  TimePoint frameDeadline;
+  size_t batchAudioBytes;
+  size_t batchBytes;
+  chrono::milliseconds maxLatency;
+  atomic<uint64_t> sentFrames;
+  atomic<uint64_t> sentBytes;
+  void appendAudio(const AudioChunk &audioChunk, string &encoded);
+  void appendPayload(const string &payload, size_t audioBytes, TimePoint captureTime);
+  void sendFrame(const string &payload);
+  void flushFrame();
+  void sendQueuedAudio(size_t blockBytes);
+
+  // Connection is restored with exponential backoff and jitter; the in-flight utterance is replayed after that.
+  atomic<bool> isStarted;
+  TimePoint connectTime;
+  // Link state as seen by the sender thread, updated once per loop. Audio and EOF are sent only when it's set,
+  // so a connection opened in between never gets new frames ahead of the replayed ones.
+  bool wasConnected;
+  bool wasEverConnected;
+  int reconnectAttempts;
+  TimePoint nextReconnectTime;
+  chrono::milliseconds reconnectMinDelay;
+  chrono::milliseconds reconnectMaxDelay;
+  mt19937 random;
+  string replayBuffer;
+  vector<size_t> replayFrames;
+  size_t replayBufferSize;
+  TimePoint utteranceStartTime;
+  chrono::milliseconds listeningTimeout;
+  bool isUtteranceActive;
+  bool isUtteranceEnded;
+  // Final results counted by the transport's callback thread: the utterance is answered by the first one after its EOF.
+  bool isEofSent;
+  atomic<uint64_t> finalResults;
+  uint64_t eofFinalResults;
+  bool isReplayable;
+  bool isUtteranceDropped;
+  atomic<uint64_t> reconnects;
+  atomic<uint64_t> bufferedBytes;
+  atomic<uint64_t> peakBufferedBytes;
+  atomic<uint64_t> droppedUtterances;
+  void scheduleReconnect(TimePoint now);
+  void reconnectIfDue();
+  void bufferFrame(const string &payload);
+  void replayUtterance();
+  void startUtterance();
+  void sendEof();
+  bool isUtteranceAnswered();
+  void finishUtterance();
+  void dropUtterance();
+
+public:
+  AsrClient(Config *config, LatencyTracker *latencyTracker, size_t blockBytes, int rate, int channels);
+  void connect(const string &address);
+  void disconnect();
+  bool send(AudioChunk &&audioChunk);
+  bool send(const AudioView &audio);
+  bool startOfStream(int direction);
+  bool endOfStream();
+  bool isConnected();
+  bool isTranscribeReceived();
+  bool takeTranscribe();
+  void isTranscribed(bool state);
+  TimePoint transcribeReceivedTime();
+  AudioQueueStats queueStats();
+  EncoderStats encoderStats();
+  FrameStats frameStats();
+  ReconnectStats reconnectStats();
+};
+
+#endif
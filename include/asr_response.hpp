@@ -0,0 +1,66 @@
+#ifndef ASR_RESPONSE_HPP
+#define ASR_RESPONSE_HPP
+
+#define ASR_MAX_DEPTH 16
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Recognized word of a final transcribe. Times are in seconds since the stream start, -1 when unknown.
+ */
+struct AsrWord
+{
+  string word;
+  double start;
+  double end;
+  double confidence;
+};
+
+/**
+ * Fields of a Vosk-like ASR server response: {"partial": "..."} while the user speaks,
+ * {"result": [{"conf": 1.0, "word": "..."}, ...], "text": "..."} for a final transcribe.
+ */
+struct AsrResponse
+{
+  string text;
+  string partial;
+  bool hasText;
+  bool hasPartial;
+  bool hasResult;
+  vector<AsrWord> words;
+  // Average confidence of the result's words, -1 when the server doesn't report it.
+  double confidence;
+};
+
+/**
+ * Single pass scanner, which extracts the fields above and skips everything else without building a DOM.
+ * It never throws: malformed input is reported by the return value. Strings of the response are reused between messages.
+ */
+class AsrResponseParser
+{
+private:
+  const char *position;
+  const char *end;
+  int depth;
+
+  void skipSpaces();
+  bool consume(char c);
+  bool peek(char c);
+  bool readKey(const char *&key, size_t &length);
+  bool readString(string *value);
+  bool readNumber(double &value);
+  bool readResult(AsrResponse &response);
+  bool readWord(AsrWord &word);
+  bool skipValue();
+  static bool isKey(const char *key, size_t length, const char *name);
+  static void appendUtf8(string &value, uint32_t codePoint);
+
+public:
+  bool parse(const string &message, AsrResponse &response);
+};
+
+#endif
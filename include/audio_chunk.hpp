@@ -0,0 +1,39 @@
+#ifndef AUDIO_CHUNK_HPP
+#define AUDIO_CHUNK_HPP
+
+#include <chrono>
+#include <string>
+
+using namespace std;
+using SteadyClock = chrono::steady_clock;
+using TimePoint = chrono::time_point<SteadyClock>;
+
+enum class ChunkKind
+{
+  Audio,
+  // Mark utterance boundaries, so they are handled in order with the audio around them.
+  StartOfStream,
+  EndOfStream
+};
+
+/**
+ * Processed audio block. Chunks are moved (buffers swapped) on their way from the DSP output to the socket,
+ * so the samples are never copied in between.
+ */
+struct AudioChunk
+{
+  string data;
+  TimePoint captureTime;
+  ChunkKind kind = ChunkKind::Audio;
+};
+
+/**
+ * Non-owning view over audio samples which live somewhere else.
+ */
+struct AudioView
+{
+  const char *data;
+  size_t size;
+};
+
+#endif
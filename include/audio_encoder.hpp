@@ -0,0 +1,90 @@
+#ifndef AUDIO_ENCODER_HPP
+#define AUDIO_ENCODER_HPP
+
+#define OPUS_FRAME_MS 20
+#define OPUS_MAX_PACKET 1500
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef WITH_OPUS
+#include <opus/opus.h>
+#endif
+
+using namespace std;
+
+/**
+ * Compression stage between the DSP output and the socket. Encoders run on the transport's sender thread.
+ */
+class AudioEncoder
+{
+public:
+  virtual ~AudioEncoder() {}
+  virtual string name() = 0;
+  virtual void encode(const string &pcm, string &encoded) = 0;
+  // Encode whatever is still buffered at the end of an utterance.
+  virtual void flush(string &encoded) { encoded.clear(); }
+  // Start the next utterance from a clean state.
+  virtual void reset() {}
+};
+
+/**
+ * IMA ADPCM, 4 bits per sample (~4x smaller than 16-bit PCM).
+ * Every encoded block starts with the number of samples per channel (uint16 LE), so blocks can be concatenated,
+ * followed by a 4-byte header per channel: predictor (int16 LE), step index, reserved byte.
+ * Nibbles of interleaved samples follow, low nibble first.
+ */
+class AdpcmEncoder : public AudioEncoder
+{
+private:
+  struct ChannelState
+  {
+    int predictor;
+    int index;
+  };
+
+  vector<ChannelState> states;
+  uint8_t encodeSample(ChannelState &state, int16_t sample);
+
+public:
+  AdpcmEncoder(int channels);
+  string name();
+  void encode(const string &pcm, string &encoded);
+  void reset();
+};
+
+#ifdef WITH_OPUS
+/**
+ * Opus packets of OPUS_FRAME_MS each. Blocks are accumulated until a full frame is available,
+ * so one encoded chunk may hold zero or more packets, each prefixed with its length (uint16 LE).
+ * The last partial frame of an utterance is padded with silence.
+ */
+class OpusAudioEncoder : public AudioEncoder
+{
+private:
+  OpusEncoder *encoder;
+  int channels;
+  size_t frameSamples;
+  vector<int16_t> pending;
+  unsigned char packet[OPUS_MAX_PACKET];
+  void encodePacket(const int16_t *samples, string &encoded);
+
+public:
+  OpusAudioEncoder(int rate, int channels, int bitrate);
+  ~OpusAudioEncoder();
+  bool isCreated();
+  string name();
+  void encode(const string &pcm, string &encoded);
+  void flush(string &encoded);
+  void reset();
+};
+#endif
+
+/**
+ * Returns nullptr for "pcm": raw blocks are sent as is.
+ */
+unique_ptr<AudioEncoder> createAudioEncoder(const string &codec, int rate, int channels, int bitrate);
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef AUDIO_QUEUE_HPP
+#define AUDIO_QUEUE_HPP
+
+#define QUEUE_WAIT_TIMEOUT 100
+#define QUEUE_MARKER_DEPTH 8
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "audio_chunk.hpp"
+
+using namespace std;
+
+/**
+ * What to do with a new audio block when the queue is full.
+ */
+enum class OverflowPolicy
+{
+  DropOldest,
+  DropNewest,
+  Block
+};
+
+struct AudioQueueStats
+{
+  size_t capacity;
+  size_t highWaterMark;
+  uint64_t pushed;
+  uint64_t copied;
+  uint64_t dropped;
+};
+
+OverflowPolicy textToOverflowPolicy(const string &policy);
+
+/**
+ * Bounded lock-free ring of preallocated audio blocks between the audio thread (single producer)
+ * and the transport sender thread (single consumer).
+ *
+ * Slots are sequenced the same way as in D. Vyukov's bounded queue, so the producer may also act as
+ * a consumer to discard the oldest block (DropOldest) without racing the sender thread.
+ * Moved chunks are swapped in and out of the slots rather than copied: samples are never copied on their way to the sender,
+ * and a producer which fills the buffer it gets back in place (file source) allocates nothing per block.
+ * librespeaker returns every block by value though, so with the DSP chain one buffer per block is still allocated by the library.
+ *
+ * Utterance markers are never dropped: they are kept apart from the blocks, tagged with the position of the next block,
+ * and popped in order with them.
+ */
+class AudioQueue
+{
+private:
+  struct Slot
+  {
+    atomic<size_t> sequence;
+    AudioChunk chunk;
+  };
+
+  struct Marker
+  {
+    ChunkKind kind;
+    size_t position;
+    TimePoint captureTime;
+  };
+
+  unique_ptr<Slot[]> slots;
+  size_t capacity;
+  size_t mask;
+  OverflowPolicy policy;
+  AudioChunk dropped;
+  Marker markers[QUEUE_MARKER_DEPTH];
+  atomic<size_t> markerHead;
+  atomic<size_t> markerTail;
+
+  atomic<size_t> enqueuePos;
+  atomic<size_t> dequeuePos;
+  atomic<bool> closed;
+
+  // Counters
+  atomic<size_t> highWaterMark;
+  atomic<uint64_t> pushedCount;
+  atomic<uint64_t> copiedCount;
+  atomic<uint64_t> droppedCount;
+
+  // Sleeping is only used when one side has nothing to do; the other side takes the lock only if someone waits.
+  mutex waitLock;
+  condition_variable notEmpty;
+  condition_variable notFull;
+  atomic<bool> isConsumerWaiting;
+  atomic<bool> isProducerWaiting;
+
+  bool tryPush(AudioChunk *chunk, const AudioView &view);
+  bool push(AudioChunk *chunk, const AudioView &view);
+  bool tryPop(AudioChunk &chunk, bool takeMarkers);
+  bool hasMarker();
+  void wakeConsumer();
+  void wakeProducer();
+
+public:
+  AudioQueue(size_t depth, OverflowPolicy policy, size_t blockBytes);
+  bool push(AudioChunk &&chunk);
+  bool push(const AudioView &view);
+  bool pushMarker(ChunkKind kind);
+  bool tryPop(AudioChunk &chunk);
+  bool waitPop(AudioChunk &chunk, chrono::milliseconds timeout);
+  void close();
+  size_t size();
+  AudioQueueStats stats();
+};
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef AUDIO_SOURCE_HPP
+#define AUDIO_SOURCE_HPP
+
+#define BLOCK_SIZE_MS 8
+
+#include "audio_chunk.hpp"
+#include "config.hpp"
+
+/**
+ * Anything which produces processed audio blocks and detects a wake word in them.
+ */
+class AudioSource
+{
+public:
+  virtual ~AudioSource() {}
+  virtual bool startListening(bool *interrupt) = 0;
+  virtual int channels() = 0;
+  virtual int rate() = 0;
+  virtual int soundDirection() = 0;
+  virtual void stopAudioProcessing() = 0;
+  virtual void processAudio(AudioChunk &chunk, int &detected) = 0;
+
+  /**
+   * Apply settings of a reloaded config which don't require the audio chain to be rebuilt.
+   */
+  virtual void reconfigure(Config *config) {}
+};
+
+/**
+ * Create audio source of a type specified in config: librespeaker DSP chain or file replay.
+ */
+AudioSource *createAudioSource(Config *config);
+
+#endif
@@ -20,6 +20,12 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/stat.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
 #include <linux/spi/spidev.h>
@@ -33,17 +39,62 @@
 /* Beware: you may need to change the formate here */
 #define SPI_DEVICE "/dev/spidev%d.%d"
 
-#define RETRY_TIMES 5
-#define RETRY_GAP_SEC 10
+/* SPI device may show up late on boot: retry with a doubling gap, ~25 s in total */
+#define RETRY_TIMES 8
+#define RETRY_GAP_MS 100
 
+/* Named pipe of the file backend is reopened at most once in this many seconds while there's no reader */
+#define FIFO_REOPEN_S 1
+
+/* Where frames go: real LEDs, a text file / pipe with a timestamped line per frame, or nowhere */
+typedef enum
+{
+    cAPA102_SPIDEV = 0,
+    cAPA102_FILE,
+    cAPA102_NULL
+} cAPA102_BACKEND;
+
+#define START_FRAME_LEN 4
+
+/*
+ * Pixels are written directly into the only transmit frame: the SPI ioctl is synchronous,
+ * so the frame is free to change as soon as a refresh returns.
+ */
 typedef struct
 {
     uint32_t number;
     int fd_spi;
     uint8_t *pixels;
     uint8_t brightness;
+    cAPA102_BACKEND backend;
+    char *line;
+    uint8_t is_fifo;
+    time_t reopen_at;
+    uint8_t *tx;
+    uint32_t tx_len;
+    uint8_t dirty;
+    uint64_t transfers;
+    uint64_t bytes;
+    uint64_t skipped;
+    struct timespec since;
 } cAPA102_LEDs;
 
+typedef struct
+{
+    uint64_t transfers;
+    uint64_t bytes;
+    uint64_t skipped;
+    double seconds;
+} cAPA102_Stats;
+
+/**
+ * @brief: Choose an output backend. Must be called before cAPA102_Init, SPI device is used by default.
+ *
+ * @param[in] backend: SPI device, file or null sink
+ * @param[in] path: Output file or named pipe for the file backend
+ */
+void cAPA102_Set_Backend(cAPA102_BACKEND backend, const char *path);
+
 /**
  * @brief: Initialise a set of apa102 LEDs
  *
@@ -112,16 +163,37 @@ void cAPA102_Set_Pixel_4byte(uint32_t index, uint32_t colour);
  */
 uint32_t cAPA102_Get_Pixel_4byte(uint32_t index);
 
+/**
+ * @brief: Set the same colour for all the pixels
+ *
+ * @param[in] colour: 24 bits colour data
+ */
+void cAPA102_Fill_4byte(uint32_t colour);
+
+/**
+ * @brief: Replace all the pixels with a prepared frame
+ *
+ * @param[in] pixels: 4 bytes per pixel in wire layout: global brightness, blue, green, red
+ */
+void cAPA102_Load_Frame(const uint8_t *pixels);
+
 /**
  * @brief: Clear all the pixels
  */
 void cAPA102_Clear_All(void);
 
 /**
- * @brief: Refresh display (After modifing pixel colour)
+ * @brief: Refresh display (After modifing pixel colour). Nothing is sent if pixels are unchanged since the last refresh.
  */
 void cAPA102_Refresh(void);
 
+/**
+ * @brief: Get SPI transfer counters since initialisation
+ *
+ * @param[out] stats: Transfers, bytes, skipped unchanged frames and elapsed seconds
+ */
+void cAPA102_Get_Stats(cAPA102_Stats *stats);
+
 /**
  * @brief: Close SPI file, release memory
  */
@@ -33,6 +33,13 @@ typedef enum
 #define C_RESPEAKER_STR "respeaker"
 #define C_HARDWARE_STR "hardware"
 #define C_PIXEL_RING_STR "pixelRing"
+#define C_STREAMING_STR "streaming"
+#define C_VAD_STR "vad"
+#define C_AUDIO_SOURCE_STR "audioSource"
+#define C_METRICS_STR "metrics"
+#define C_LOGGING_STR "logging"
+#define C_TRANSCRIPTS_STR "transcripts"
+#define C_SHARED_MEMORY_STR "sharedMemory"
 
 #define RSP_KWS_MODEL_STR "kwsModelName"
 #define RSP_KWS_SENSITIVITY_STR "kwsSensitivity"
@@ -43,10 +50,48 @@ typedef enum
 #define RSP_WAV_LOG_STR "enableWavLog"
 #define RSP_AGC_STR "agc"
 
+#define ST_QUEUE_DEPTH_STR "queueDepth"
+#define ST_OVERFLOW_POLICY_STR "overflowPolicy"
+#define ST_PRE_ROLL_DURATION_STR "preRollDuration"
+#define ST_CODEC_STR "codec"
+#define ST_BITRATE_STR "bitrate"
+#define ST_BATCH_DURATION_STR "batchDuration"
+#define ST_BATCH_SIZE_STR "batchSize"
+#define ST_MAX_LATENCY_STR "maxLatency"
+#define ST_RECONNECT_MIN_DELAY_STR "reconnectMinDelay"
+#define ST_RECONNECT_MAX_DELAY_STR "reconnectMaxDelay"
+#define ST_REPLAY_BUFFER_SIZE_STR "replayBufferSize"
+
+#define VAD_ENABLED_STR "enabled"
+#define VAD_THRESHOLD_STR "threshold"
+#define VAD_TRAILING_SILENCE_STR "trailingSilence"
+
+#define AS_TYPE_STR "type"
+#define AS_PATH_STR "path"
+#define AS_FORMAT_STR "format"
+#define AS_PACING_STR "pacing"
+#define AS_LOOP_STR "loop"
+#define AS_RATE_STR "rate"
+#define AS_CHANNELS_STR "channels"
+#define AS_WAKE_WORD_POSITION_STR "wakeWordPosition"
+
+#define MT_REPORT_INTERVAL_STR "reportInterval"
+#define MT_DUMP_PATH_STR "dumpPath"
+
+#define LG_LEVEL_STR "level"
+#define LG_JSON_STR "json"
+
+#define TR_SOCKET_PATH_STR "socketPath"
+
+#define SHM_SOCKET_PATH_STR "socketPath"
+#define SHM_CAPACITY_STR "capacity"
+
 #define HW_POWER_STR "power"
 #define HW_LED_NUM "ledsAmount"
 #define HW_LED_SPI_BUS "spiBus"
 #define HW_LED_SPI_DEV "spiDev"
+#define HW_LED_BACKEND "ledBackend"
+#define HW_LED_OUTPUT "ledOutput"
 #define HW_GPIO_PIN "gpioPin"
 #define HW_GPIO_VAL "gpioVal"
 #define HW_MODEL_STR "model"
@@ -63,6 +108,16 @@ typedef enum
 #define PR_MUTE_COLOR_STR "muteColor"
 #define PR_UNMUTE_COLOR_STR "unmuteColor"
 #define PR_MUTE_STR "isMutedOnStart"
+#define PR_FRAME_RATE_STR "frameRate"
+#define PR_ANIMATIONS_STR "animations"
+#define PR_DOA_INDICATOR_STR "doaIndicator"
+#define PR_DOA_UPDATE_INTERVAL_STR "doaUpdateInterval"
+#define PR_DOA_SMOOTHING_STR "doaSmoothing"
+#define KF_KEYFRAMES_STR "keyframes"
+#define KF_TIME_STR "time"
+#define KF_COLORS_STR "colors"
+#define KF_EASING_STR "easing"
+#define KF_LOOP_STR "loop"
 
 #define RED_C 0xFF0000
 #define GREEN_C 0x00FF00
@@ -83,11 +138,35 @@ typedef struct
     uint32_t unmute;
 } COLOURS;
 
+/* Keyframe animation compiled into a flat table: frame_count frames of LEDs in APA102 wire layout */
+typedef struct
+{
+    uint8_t *frames;
+    uint32_t frame_count;
+    uint32_t frame_size;
+    int frame_ms;
+    uint8_t loop;
+} KEYFRAME_ANIMATION;
+
+/* LED settings which can be changed on the fly: handed over to the render thread as a whole */
+typedef struct
+{
+    uint8_t max_brightness;
+    COLOURS animation_color;
+    uint8_t animation_enable[STATE_NUM];
+    uint8_t doa_indicator;
+    double doa_smoothing;
+    /* Compiled with max_brightness, owned by the settings until the render thread takes them over */
+    KEYFRAME_ANIMATION *keyframes[STATE_NUM];
+} LED_SETTINGS;
+
 typedef struct
 {
     int number;
     int spi_bus;
     int spi_dev;
+    int backend;
+    char output[256];
 } HW_LED_SPEC;
 
 typedef struct
@@ -107,15 +186,15 @@ typedef struct
     uint8_t max_brightness;
 
     /* Animation thread */
-    pthread_t curr_thread;
+    pthread_t render_thread;
     STATE curr_state;
+    int frame_rate;
 
     /* Colour */
     COLOURS animation_color;
 
     /* Flags */
     volatile sig_atomic_t if_terminate;
-    uint8_t if_update;
     uint8_t if_disable;
 
     /* Animation Enable */
@@ -123,6 +202,13 @@ typedef struct
 
     /* Feedback sound */
     uint8_t if_mute;
+
+    /* Animations from config, replace the built-in ones */
+    KEYFRAME_ANIMATION *keyframes[STATE_NUM];
+
+    /* Direction of arrival is shown instead of the listen animation */
+    uint8_t doa_indicator;
+    double doa_smoothing;
 } RUNTIME_OPTIONS;
 
 #endif
@@ -1,9 +1,12 @@
 #ifndef CONFIG_HPP
 #define CONFIG_HPP
 
+#include <algorithm>
 #include <cstring>
 #include <fstream>
 #include <cstdlib>
+#include <string>
+#include <vector>
 
 // See JSON lib docs: https://github.com/nlohmann/json (included as a prebuilt single header)
 #include "json.hpp"
@@ -12,45 +15,200 @@
 using namespace std;
 using json = nlohmann::json;
 
+/**
+ * Typed config values. Missing keys keep these defaults.
+ */
+struct ConfigValues
+{
+  string webSocketAddress = "ws://127.0.0.1:2700";
+
+  // Respeaker
+  string kwsModelName = "snowboy.umdl";
+  string kwsSensitivityLevel = "0.6";
+  int listeningTimeout = 8000;
+  int wakeWordDetectionOffset = 300;
+  int gainLevel = 10;
+  bool isSingleBeamOutput = false;
+  bool doWaveLog = false;
+  bool doAGC = true;
+
+  // Streaming
+  int queueDepth = 64;
+  string overflowPolicy = "dropOldest";
+  int preRollDuration = 400;
+  string codec = "pcm";
+  int bitrate = 16000;
+  int batchDuration = 40;
+  int batchSize = 4096;
+  int maxLatency = 60;
+  int reconnectMinDelay = 500;
+  int reconnectMaxDelay = 30000;
+  int replayBufferSize = 1048576;
+
+  // Voice Activity Detection
+  bool isVadEnabled = true;
+  double vadThreshold = 9.0;
+  int trailingSilence = 800;
+
+  // Audio Source
+  string audioSourceType = "respeaker";
+  string audioFilePath = "-";
+  string audioFileFormat = "wav";
+  string audioPacing = "realtime";
+  bool shouldLoopAudio = false;
+  int audioFileRate = 16000;
+  int audioFileChannels = 1;
+  int wakeWordPosition = 0;
+
+  // Metrics
+  int metricsReportInterval = 60;
+  string metricsDumpPath = "latency.json";
+
+  // Logging
+  string logLevel = "info";
+  bool isJsonLog = false;
+
+  // Transcripts
+  string transcriptSocketPath = "";
+
+  // Shared Memory
+  string sharedMemorySocketPath = "";
+  int sharedMemoryCapacity = 262144;
+
+  // Pixel Ring
+  int brightness = 20;
+  int frameRate = 50;
+  json animations = json::object();
+  bool isDoaIndicatorEnabled = false;
+  int doaUpdateInterval = 100;
+  double doaSmoothing = 0.3;
+  bool isIdleAnimationEnabled = true;
+  bool isListenAnimationEnabled = true;
+  bool isSpeakAnimationEnabled = true;
+  bool isMuteAnimationEnabled = true;
+  bool isUnmuteAnimationEnabled = true;
+  string idleColor = "teal";
+  string listenColor = "blue";
+  string speakColor = "purple";
+  string muteColor = "yellow";
+  string unmuteColor = "green";
+  bool shouldMute = false;
+
+  // Hardware
+  string hardwareModelName = "Respeaker Core V2";
+  int ledsAmount = 12;
+  int spiBusNumber = 0;
+  int spiDevNumber = 0;
+  string ledBackend = "spidev";
+  string ledOutputPath = "leds.txt";
+  int powerPin = 66;
+  int powerPinValue = 0;
+};
+
+/**
+ * Config file is parsed and validated once, so getters are plain field reads.
+ */
 class Config
 {
 private:
-  json data;
+  ConfigValues values;
+  vector<string> errors;
+  bool isParsed;
+
+  void parse(const json &data);
+  const json &section(const json &data, const string &path, const char *name);
+  template <typename T>
+  void read(const json &section, const string &path, const char *key, T &value);
+  void check(bool isValid, const string &error);
+  void checkAnimations(const json &animations);
+
 public:
   Config(const char* name);
   bool isRead();
+  const vector<string> &validationErrors();
 
   // Respeaker
-  string kwsModelName();
-  string kwsSensitivityLevel();
-  int listeningTimeout();
-  int gainLevel();
-  bool doAGC();
-  bool doWaveLog();
-  bool isSingleBeamOutput();
+  const string &kwsModelName() { return values.kwsModelName; }
+  const string &kwsSensitivityLevel() { return values.kwsSensitivityLevel; }
+  int listeningTimeout() { return values.listeningTimeout; }
+  int wakeWordDetectionOffset() { return values.wakeWordDetectionOffset; }
+  int gainLevel() { return values.gainLevel; }
+  bool doAGC() { return values.doAGC; }
+  bool doWaveLog() { return values.doWaveLog; }
+  bool isSingleBeamOutput() { return values.isSingleBeamOutput; }
 
   // Pixel Ring
-  string hardwareModelName();
-  string idleColor();
-  string listenColor();
-  string speakColor();
-  string muteColor();
-  string unmuteColor();
-  int brightness();
-  int ledsAmount();
-  int spiBusNumber();
-  int spiDevNumber();
-  int powerPin();
-  int powerPinValue();
-  bool isIdleAnimationEnabled();
-  bool isListenAnimationEnabled();
-  bool isSpeakAnimationEnabled();
-  bool isMuteAnimationEnabled();
-  bool isUnmuteAnimationEnabled();
-  bool shouldMute();
+  const string &hardwareModelName() { return values.hardwareModelName; }
+  const string &idleColor() { return values.idleColor; }
+  const string &listenColor() { return values.listenColor; }
+  const string &speakColor() { return values.speakColor; }
+  const string &muteColor() { return values.muteColor; }
+  const string &unmuteColor() { return values.unmuteColor; }
+  int brightness() { return values.brightness; }
+  int frameRate() { return values.frameRate; }
+  const json &animations() { return values.animations; }
+  bool isDoaIndicatorEnabled() { return values.isDoaIndicatorEnabled; }
+  int doaUpdateInterval() { return values.doaUpdateInterval; }
+  double doaSmoothing() { return values.doaSmoothing; }
+  int ledsAmount() { return values.ledsAmount; }
+  int spiBusNumber() { return values.spiBusNumber; }
+  int spiDevNumber() { return values.spiDevNumber; }
+  const string &ledBackend() { return values.ledBackend; }
+  const string &ledOutputPath() { return values.ledOutputPath; }
+  int powerPin() { return values.powerPin; }
+  int powerPinValue() { return values.powerPinValue; }
+  bool isIdleAnimationEnabled() { return values.isIdleAnimationEnabled; }
+  bool isListenAnimationEnabled() { return values.isListenAnimationEnabled; }
+  bool isSpeakAnimationEnabled() { return values.isSpeakAnimationEnabled; }
+  bool isMuteAnimationEnabled() { return values.isMuteAnimationEnabled; }
+  bool isUnmuteAnimationEnabled() { return values.isUnmuteAnimationEnabled; }
+  bool shouldMute() { return values.shouldMute; }
 
   // WebSocket
-  string webSocketAddress();
+  const string &webSocketAddress() { return values.webSocketAddress; }
+
+  // Streaming
+  int queueDepth() { return values.queueDepth; }
+  const string &overflowPolicy() { return values.overflowPolicy; }
+  int preRollDuration() { return values.preRollDuration; }
+  const string &codec() { return values.codec; }
+  int bitrate() { return values.bitrate; }
+  int batchDuration() { return values.batchDuration; }
+  int batchSize() { return values.batchSize; }
+  int maxLatency() { return values.maxLatency; }
+  int reconnectMinDelay() { return values.reconnectMinDelay; }
+  int reconnectMaxDelay() { return values.reconnectMaxDelay; }
+  int replayBufferSize() { return values.replayBufferSize; }
+
+  // Voice Activity Detection
+  bool isVadEnabled() { return values.isVadEnabled; }
+  double vadThreshold() { return values.vadThreshold; }
+  int trailingSilence() { return values.trailingSilence; }
+
+  // Audio Source
+  const string &audioSourceType() { return values.audioSourceType; }
+  const string &audioFilePath() { return values.audioFilePath; }
+  const string &audioFileFormat() { return values.audioFileFormat; }
+  const string &audioPacing() { return values.audioPacing; }
+  bool shouldLoopAudio() { return values.shouldLoopAudio; }
+  int audioFileRate() { return values.audioFileRate; }
+  int audioFileChannels() { return values.audioFileChannels; }
+  int wakeWordPosition() { return values.wakeWordPosition; }
+
+  // Metrics
+  int metricsReportInterval() { return values.metricsReportInterval; }
+  const string &metricsDumpPath() { return values.metricsDumpPath; }
+
+  // Logging
+  const string &logLevel() { return values.logLevel; }
+  bool isJsonLog() { return values.isJsonLog; }
+
+  // Transcripts
+  const string &transcriptSocketPath() { return values.transcriptSocketPath; }
+
+  // Shared Memory
+  const string &sharedMemorySocketPath() { return values.sharedMemorySocketPath; }
+  int sharedMemoryCapacity() { return values.sharedMemoryCapacity; }
 };
 
 #endif
@@ -0,0 +1,44 @@
+#ifndef CONFIG_RELOADER_HPP
+#define CONFIG_RELOADER_HPP
+
+#define RELOAD_SETTLE_MS 100
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "config.hpp"
+
+using namespace std;
+
+/**
+ * Watches config file (inotify) and SIGHUP requests, re-reads and validates the file on a background thread.
+ * A valid config is published as a new immutable snapshot: readers load the pointer and keep their copy for as long as they need it.
+ * An invalid one is reported and ignored, the previous snapshot stays.
+ */
+class ConfigReloader
+{
+private:
+  string path;
+  shared_ptr<Config> snapshot;
+  atomic<uint64_t> generation;
+  atomic<bool> isRunning;
+  int wakeupFd;
+  int inotifyFd;
+  thread watcher;
+
+  void watch();
+  void reload();
+
+public:
+  ConfigReloader(const string &path, Config *config);
+  ~ConfigReloader();
+  bool start();
+  void stop();
+  void requestReload();
+  shared_ptr<Config> current();
+  uint64_t version();
+};
+
+#endif
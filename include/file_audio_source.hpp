@@ -0,0 +1,58 @@
+#ifndef FILE_AUDIO_SOURCE_HPP
+#define FILE_AUDIO_SOURCE_HPP
+
+#define WAV_HEADER_SIZE 12
+#define WAV_CHUNK_HEADER_SIZE 8
+#define WAV_PCM_FORMAT 1
+#define STDIN_PATH "-"
+
+#include <cstdio>
+#include <string>
+
+#include "audio_source.hpp"
+
+using namespace std;
+
+/**
+ * Replays WAV (16-bit PCM) or raw PCM audio from a file or stdin ("-") instead of capturing it,
+ * so the rest of the pipeline can be exercised and profiled without a ReSpeaker board.
+ * Audio is expected to be already processed. A wake word is reported at a fixed position of each pass.
+ */
+class FileAudioSource : public AudioSource
+{
+private:
+  string path;
+  FILE *file;
+  bool isWav;
+  bool isRealtime;
+  bool shouldLoop;
+  int sampleRate;
+  int channelCount;
+  size_t blockBytes;
+
+  // Position within the current pass
+  size_t dataSize;
+  size_t position;
+  size_t wakeWordPosition;
+  bool isWakeWordReported;
+
+  bool *interrupt;
+  TimePoint startTime;
+  uint64_t replayedBytes;
+
+  bool open();
+  bool readWavHeader();
+  bool skip(size_t size);
+
+public:
+  FileAudioSource(Config *config);
+  ~FileAudioSource();
+  bool startListening(bool *interrupt);
+  int channels();
+  int rate();
+  int soundDirection();
+  void stopAudioProcessing();
+  void processAudio(AudioChunk &chunk, int &detected);
+};
+
+#endif
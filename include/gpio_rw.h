@@ -11,6 +11,9 @@
 #define VALUE_MAX 30
 #define DIRECTION_MAX 35
 
+#define GPIO_POLL_MS 5
+#define GPIO_READY_TIMEOUT 1000
+
 /**
  * @brief: export a GPIO port
  *
@@ -29,6 +32,16 @@ int cGPIO_export(int pin);
  */
 int cGPIO_unexport(int pin);
 
+/**
+ * @brief: wait until an exported pin can be configured: sysfs files show up and get their permissions asynchronously
+ *
+ * @param[in] pin bcm number of the pin
+ * @param[in] timeout_ms how long to wait
+ *
+ * @returns \-1 timed out or \0 ready
+ */
+int cGPIO_wait_ready(int pin, int timeout_ms);
+
 /**
  * @brief: set direction
  *
@@ -0,0 +1,70 @@
+#ifndef LATENCY_TRACKER_HPP
+#define LATENCY_TRACKER_HPP
+
+#define HISTOGRAM_BUCKETS 128
+#define HISTOGRAM_MIN_MS 1.0
+#define HISTOGRAM_GROWTH 1.1
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "audio_chunk.hpp"
+
+using namespace std;
+
+/**
+ * Points of an utterance's life, all measured relative to the wake word detection.
+ */
+enum LatencyMark
+{
+  WAKE_WORD = 0,
+  FIRST_ENQUEUED,
+  FIRST_SENT,
+  FIRST_PARTIAL,
+  FINAL_RESULT,
+  LATENCY_MARKS_NUM
+};
+
+/**
+ * Log-scale histogram of latencies in ms: each bucket is HISTOGRAM_GROWTH times wider than the previous one.
+ */
+class LatencyHistogram
+{
+private:
+  uint64_t buckets[HISTOGRAM_BUCKETS];
+  uint64_t count;
+  double max;
+
+public:
+  LatencyHistogram();
+  void record(double ms);
+  double percentile(double p);
+  uint64_t samples();
+  double maximum();
+};
+
+/**
+ * Marks may come from any thread (audio loop, sender thread, transport callback), only the first one per utterance counts.
+ * Histograms are updated and reported from the main loop only.
+ */
+class LatencyTracker
+{
+private:
+  atomic<int64_t> marks[LATENCY_MARKS_NUM];
+  LatencyHistogram histograms[LATENCY_MARKS_NUM];
+  chrono::seconds reportInterval;
+  string dumpPath;
+  TimePoint lastReportTime;
+
+  void report();
+  void dump();
+
+public:
+  LatencyTracker(int reportInterval, const string &dumpPath);
+  void begin(TimePoint wakeWordTime);
+  void mark(LatencyMark mark);
+  void finish();
+};
+
+#endif
@@ -21,9 +21,14 @@ extern "C"
 #include <fstream>
 
 #include "config.hpp"
-#include "ws_transport.hpp"
+#include "config_reloader.hpp"
+#include "asr_client.hpp"
+#include "shm_audio_ring.hpp"
 #include "pixel_ring.hpp"
-#include "respeaker_core.hpp"
+#include "audio_source.hpp"
+#include "pre_roll_buffer.hpp"
+#include "voice_activity_detector.hpp"
+#include "latency_tracker.hpp"
 
 using namespace std;
 // using namespace respeaker;
@@ -34,30 +39,36 @@ using TimePoint = chrono::time_point<SteadyClock>;
 #define CONFIG_FILE "config.json"
 
 // Key entities
-WsTransport *wsClient;
+AsrClient *asrClient;
+ShmAudioRing *audioRing;
 Config *config;
-RespeakerCore* respeakerCore;
+ConfigReloader *configReloader;
+AudioSource* audioSource;
+PreRollBuffer* preRoll;
+VoiceActivityDetector* vad;
+LatencyTracker* latencyTracker;
 
 // Common flow flags
 static bool isWakeWordDetected = false;
 static bool shouldStopListening = false;
+static volatile sig_atomic_t caughtSignal = 0;
 
 // Default pixel ring config
 RUNTIME_OPTIONS RUNTIME = {
     /* Hardware */
     "",
-    {-1, -1, -1},
+    {-1, -1, -1, 0, ""},
     {-1, -1},
     /* Brightness */
     31,
     /* Animation thread */
     0, // NULL
     ON_IDLE,
+    50,
     /* Colour */
     {GREEN_C, BLUE_C, PURPLE_C, YELLOW_C, GREEN_C},
     /* Flags */
     0,
-    1,
     0,
     /* Animation Enable */
     {1, 1, 1, 1, 1, 1},
@@ -66,12 +77,32 @@ RUNTIME_OPTIONS RUNTIME = {
 
 void handleQuit(int signal);
 
+void handleReload(int signal);
+
+void applyConfig(Config *previous, Config *next);
+
+void configureLogging(Config* config);
+
 void configureSignalHandler();
 
 void cleanup(int status);
 
-void enablePixelRing(Config* config);
+bool enablePixelRing(Config* config);
+
+void connectToAsrServer(Config* config);
+
+void openAudioRing(Config* config);
+
+void logStartupTimes(TimePoint startTime, TimePoint configTime, chrono::nanoseconds audioSourceDuration, chrono::nanoseconds pixelRingDuration);
 
 bool trackPixelRingState();
 
+size_t bytesPerMs();
+
+void logEndOfSpeechLatency(TimePoint speechEndTime, TimePoint endOfStreamTime);
+
+void logStreamingStats(TimePoint detectTime);
+
+void logTranscribeReaction(TimePoint transcribeTime);
+
 #endif
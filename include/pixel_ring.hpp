@@ -2,12 +2,15 @@
 #define __PIXEL_RING_HPP__
 
 #include "config.hpp"
+#include <vector>
 extern "C"
 {
 #include "common.h"
 #include "verbose.h"
 #include "gpio_rw.h"
+#include "cAPA102.h"
 #include "state_handler.h"
+#include "animation.h"
 }
 
 extern RUNTIME_OPTIONS RUNTIME;
@@ -15,13 +18,17 @@ extern RUNTIME_OPTIONS RUNTIME;
 using namespace std;
 
 /**
- * Basic color conversion API. 
+ * Basic color conversion API: one of the known names or #RRGGBB.
  */
 uint32_t textToColour(const char *cTxt)
 {
   if (strlen(cTxt))
   {
-    if (!strcmp(cTxt, "red"))
+    if (cTxt[0] == '#' && strlen(cTxt) == 7 && strspn(cTxt + 1, "0123456789abcdefABCDEF") == 6)
+    {
+      return strtoul(cTxt + 1, nullptr, 16);
+    }
+    else if (!strcmp(cTxt, "red"))
     {
       return RED_C;
     }
@@ -53,6 +60,149 @@ uint32_t textToColour(const char *cTxt)
   return 0;
 }
 
+/**
+ * LED output: real SPI device, timestamped frames in a file / pipe, or nothing.
+ */
+cAPA102_BACKEND textToLedBackend(const string &backend)
+{
+  if (backend == "file")
+  {
+    return cAPA102_FILE;
+  }
+  else if (backend == "null")
+  {
+    return cAPA102_NULL;
+  }
+  return cAPA102_SPIDEV;
+}
+
+/**
+ * Eased progress between two keyframes, t is in [0, 1].
+ */
+double easeKeyframe(const string &easing, double t)
+{
+  if (easing == "step")
+  {
+    return t < 1 ? 0 : 1;
+  }
+  else if (easing == "easeIn")
+  {
+    return t * t;
+  }
+  else if (easing == "easeOut")
+  {
+    return 1 - (1 - t) * (1 - t);
+  }
+  else if (easing == "easeInOut")
+  {
+    return t * t * (3 - 2 * t);
+  }
+  return t;
+}
+
+/**
+ * Render keyframes into a flat table of ready-to-send frames, one per frameMs. Colour patterns shorter than the ring are repeated.
+ * Must be called after cAPA102_Init, as frames include the global brightness.
+ */
+KEYFRAME_ANIMATION *compileAnimation(const string &name, json &definition, bool loopByDefault, uint8_t maxBrightness)
+{
+  json &keyframes = definition[KF_KEYFRAMES_STR];
+  if (!keyframes.is_array() || keyframes.empty())
+  {
+    verbose(V_NORMAL, stderr, "Animation %s has no keyframes", name.c_str());
+    return nullptr;
+  }
+
+  int ledsAmount = RUNTIME.LEDs.number;
+  int frameMs = 1000 / (RUNTIME.frame_rate > 0 ? RUNTIME.frame_rate : DEFAULT_FRAME_RATE);
+  vector<int> times;
+  vector<vector<uint32_t>> colours;
+  vector<string> easings;
+
+  for (auto &keyframe : keyframes)
+  {
+    int time = keyframe.value(KF_TIME_STR, 0);
+    json &pattern = keyframe[KF_COLORS_STR];
+    if ((!times.empty() && time < times.back()) || !pattern.is_array() || pattern.empty())
+    {
+      verbose(V_NORMAL, stderr, "Animation %s: keyframes must go in time order and have colors", name.c_str());
+      return nullptr;
+    }
+
+    vector<uint32_t> ledColours(ledsAmount);
+    for (int led = 0; led < ledsAmount; led++)
+    {
+      ledColours[led] = textToColour(pattern[led % pattern.size()].get<string>().c_str());
+    }
+    times.push_back(time);
+    colours.push_back(ledColours);
+    easings.push_back(keyframe.value(KF_EASING_STR, "linear"));
+  }
+
+  KEYFRAME_ANIMATION *animation = (KEYFRAME_ANIMATION *)calloc(1, sizeof(KEYFRAME_ANIMATION));
+  animation->frame_count = times.back() / frameMs + 1;
+  animation->frame_size = ledsAmount * 4;
+  animation->frame_ms = frameMs;
+  animation->loop = definition.value(KF_LOOP_STR, loopByDefault);
+  animation->frames = (uint8_t *)malloc(animation->frame_count * animation->frame_size);
+
+  uint8_t globalBrightness = 0xE0 | cAPA102_Get_Brightness();
+  size_t segment = 0;
+  for (uint32_t frame = 0; frame < animation->frame_count; frame++)
+  {
+    int time = frame * frameMs;
+    while (segment + 1 < times.size() && time >= times[segment + 1])
+    {
+      segment++;
+    }
+
+    // Frames before the first keyframe hold its colours.
+    size_t next = segment + 1 < times.size() ? segment + 1 : segment;
+    double t = next == segment ? 0 : (double)(time - times[segment]) / (times[next] - times[segment]);
+    double progress = easeKeyframe(easings[next], min(max(t, 0.0), 1.0));
+    uint8_t *pixel = animation->frames + frame * animation->frame_size;
+
+    for (int led = 0; led < ledsAmount; led++, pixel += 4)
+    {
+      uint32_t from = colours[segment][led], to = colours[next][led];
+      pixel[0] = globalBrightness;
+      for (int channel = 0; channel < 3; channel++)
+      {
+        double a = (from >> (channel * 8)) & 0xFF, b = (to >> (channel * 8)) & 0xFF;
+        // Blue, green and red go in this order on the wire.
+        pixel[B_OFF_SET + channel] = (uint8_t)((a + (b - a) * progress) * maxBrightness / 255 + 0.5);
+      }
+    }
+  }
+
+  verbose(VV_INFO, stdout, "Animation %s: %u frames, %u bytes", name.c_str(), animation->frame_count, animation->frame_count * animation->frame_size);
+  return animation;
+}
+
+/**
+ * Compile animations defined in config, the rest of the states keep built-in ones (nullptr).
+ */
+void compileAnimations(Config *config, KEYFRAME_ANIMATION **keyframes)
+{
+  fill(keyframes, keyframes + STATE_NUM, nullptr);
+  json animations = config->animations();
+  if (!animations.is_object())
+  {
+    return;
+  }
+
+  const pair<const char *, STATE> names[] = {
+      {PR_ON_IDLE_STR, ON_IDLE}, {PR_ON_LISTEN_STR, ON_LISTEN}, {PR_ON_SPEAK_STR, ON_SPEAK}, {PR_TO_MUTE_STR, TO_MUTE}, {PR_TO_UNMUTE_STR, TO_UNMUTE}};
+  for (auto &name : names)
+  {
+    if (animations.contains(name.first))
+    {
+      // Transitions fall back to idle when they are over.
+      keyframes[name.second] = compileAnimation(name.first, animations[name.first], name.second != TO_MUTE && name.second != TO_UNMUTE, config->brightness());
+    }
+  }
+}
+
 /**
  * @brief: set power pin
  *
@@ -70,7 +220,8 @@ int setPowerPin()
   if (-1 == cGPIO_export(RUNTIME.power.pin))
     return -1;
 
-  sleep(1);
+  if (-1 == cGPIO_wait_ready(RUNTIME.power.pin, GPIO_READY_TIMEOUT))
+    return -1;
 
   if (-1 == cGPIO_direction(RUNTIME.power.pin, GPIO_OUT))
     return -1;
@@ -103,50 +254,87 @@ int resetPowerPin()
   return 1;
 }
 
+/**
+ * LED settings which may change on config reload.
+ */
+void readLedSettings(Config *config, LED_SETTINGS *settings)
+{
+  settings->max_brightness = config->brightness();
+  settings->animation_color.idle = textToColour(config->idleColor().c_str());
+  settings->animation_color.listen = textToColour(config->listenColor().c_str());
+  settings->animation_color.speak = textToColour(config->speakColor().c_str());
+  settings->animation_color.mute = textToColour(config->muteColor().c_str());
+  settings->animation_color.unmute = textToColour(config->unmuteColor().c_str());
+  settings->animation_enable[ON_IDLE] = config->isIdleAnimationEnabled();
+  settings->animation_enable[ON_LISTEN] = config->isListenAnimationEnabled();
+  settings->animation_enable[ON_SPEAK] = config->isSpeakAnimationEnabled();
+  settings->animation_enable[TO_MUTE] = config->isMuteAnimationEnabled();
+  settings->animation_enable[TO_UNMUTE] = config->isUnmuteAnimationEnabled();
+  settings->animation_enable[ON_DISABLED] = 1;
+  settings->doa_indicator = config->isDoaIndicatorEnabled();
+  settings->doa_smoothing = config->doaSmoothing();
+}
+
 /**
  * Populate pixel ring runtime options.
  */
 void setupPixelRing(Config* config)
 {
+  LED_SETTINGS settings;
+  readLedSettings(config, &settings);
+
   strcpy(RUNTIME.hardware_model, config->hardwareModelName().c_str());
-  RUNTIME.max_brightness = config->brightness();
-  RUNTIME.animation_color.idle = textToColour(config->idleColor().c_str());
-  RUNTIME.animation_color.listen = textToColour(config->listenColor().c_str());
-  RUNTIME.animation_color.speak = textToColour(config->speakColor().c_str());
-  RUNTIME.animation_color.mute = textToColour(config->muteColor().c_str());
-  RUNTIME.animation_color.unmute = textToColour(config->unmuteColor().c_str());
-  RUNTIME.animation_enable[ON_IDLE] = config->isIdleAnimationEnabled();
-  RUNTIME.animation_enable[ON_LISTEN] = config->isListenAnimationEnabled();
-  RUNTIME.animation_enable[ON_SPEAK] = config->isSpeakAnimationEnabled();
-  RUNTIME.animation_enable[TO_MUTE] = config->isMuteAnimationEnabled();
-  RUNTIME.animation_enable[TO_UNMUTE] = config->isUnmuteAnimationEnabled();
+  RUNTIME.max_brightness = settings.max_brightness;
+  RUNTIME.frame_rate = config->frameRate();
+  RUNTIME.animation_color = settings.animation_color;
+  memcpy(RUNTIME.animation_enable, settings.animation_enable, sizeof(RUNTIME.animation_enable));
   RUNTIME.if_mute = config->shouldMute();
   RUNTIME.LEDs.number = config->ledsAmount();
   RUNTIME.LEDs.spi_bus = config->spiBusNumber();
   RUNTIME.LEDs.spi_dev = config->spiDevNumber();
+  RUNTIME.LEDs.backend = textToLedBackend(config->ledBackend());
+  snprintf(RUNTIME.LEDs.output, sizeof(RUNTIME.LEDs.output), "%s", config->ledOutputPath().c_str());
   RUNTIME.power.pin = config->powerPin();
   RUNTIME.power.val = config->powerPinValue();
+  RUNTIME.doa_indicator = settings.doa_indicator;
+  RUNTIME.doa_smoothing = settings.doa_smoothing;
+  build_colour_luts();
+}
+
+/**
+ * Apply colours, brightness, animation switches and keyframes of a reloaded config. The render thread picks them up before its next frame.
+ * Keyframes have the brightness baked in, so they are compiled anew here rather than on the render thread.
+ */
+void reloadPixelRing(Config *config)
+{
+  LED_SETTINGS *settings = (LED_SETTINGS *)malloc(sizeof(LED_SETTINGS));
+  readLedSettings(config, settings);
+  compileAnimations(config, settings->keyframes);
+  state_machine_post_settings(settings);
 }
 
 /**
- * Perform an infinite state polling and check if we need to exit program.
+ * Check if we need to exit program. Animations are rendered by a separate thread.
  */
 bool trackPixelRingState()
 {
-  if (RUNTIME.if_update)
-  {
-    state_machine_update();
-  }
   return !RUNTIME.if_terminate;
 }
 
 /**
- * Change pixel ring pattern. It's automatically handled by the state machine.
+ * Change pixel ring pattern. It never blocks: the render thread switches to a new animation before its next frame.
  */
 void changePixelRingState(STATE state)
 {
-  RUNTIME.curr_state = state;
-  RUNTIME.if_update = 1;
+  state_machine_post(state);
+}
+
+/**
+ * Update direction of arrival shown by the pixel ring while listening. It never blocks.
+ */
+void changePixelRingDirection(int direction)
+{
+  state_machine_post_direction(direction);
 }
 
 #endif
@@ -0,0 +1,29 @@
+#ifndef PRE_ROLL_BUFFER_HPP
+#define PRE_ROLL_BUFFER_HPP
+
+#include <string>
+
+#include "audio_chunk.hpp"
+
+using namespace std;
+
+/**
+ * Circular buffer with the last N ms of processed audio. It's continuously fed from the audio thread
+ * and flushed in one burst when a wake word is detected, so the utterance start is never clipped.
+ */
+class PreRollBuffer
+{
+private:
+  string buffer;
+  size_t capacity;
+  size_t head;
+  size_t length;
+
+public:
+  PreRollBuffer(size_t capacity);
+  void write(const string &audio);
+  void flush(AudioChunk &chunk, size_t trimBytes);
+  void clear();
+};
+
+#endif
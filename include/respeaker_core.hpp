@@ -1,8 +1,6 @@
 #ifndef RESPEAKER_CORE_HPP
 #define RESPEAKER_CORE_HPP
 
-#define BLOCK_SIZE_MS 8
-
 // Audio DSP provided by Alango: https://wiki.seeedstudio.com/ReSpeaker_Core_v2.0/#closed-source-solution
 #include <respeaker.h>
 #include <chain_nodes/pulse_collector_node.h>
@@ -11,10 +9,14 @@
 #include <memory>
 
 #include "config.hpp"
+#include "audio_source.hpp"
 
 using namespace respeaker;
 
-class RespeakerCore
+/**
+ * Audio source backed by librespeaker DSP chain.
+ */
+class RespeakerCore : public AudioSource
 {
 private:
   // Respeaker config: http://respeaker.io/librespeaker_doc/index.html
@@ -22,6 +24,7 @@ private:
   unique_ptr<VepAecBeamformingNode> beamformingNode;
   unique_ptr<SnowboyMbDoaKwsNode> hotwordNode;
   unique_ptr<ReSpeaker> respeaker;
+  bool isAgcEnabled;
 public:
   RespeakerCore(Config* config);
   bool startListening(bool* interrupt);
@@ -29,7 +32,8 @@ public:
   int rate();
   int soundDirection();
   void stopAudioProcessing();
-  string processAudio(int& detected);
+  void processAudio(AudioChunk& chunk, int& detected);
+  void reconfigure(Config* config);
 };
 
 #endif
@@ -0,0 +1,125 @@
+#ifndef SHM_AUDIO_RING_HPP
+#define SHM_AUDIO_RING_HPP
+
+#define SHM_RING_MAGIC 0x52415352 // "RSAR"
+#define SHM_RING_VERSION 1
+#define SHM_ACCEPT_INTERVAL 100
+#define SHM_BACKLOG 8
+#define SHM_ALIGNMENT 8
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "audio_chunk.hpp"
+
+using namespace std;
+
+enum ShmRecordKind
+{
+  SHM_AUDIO = 0,
+  SHM_START_OF_STREAM = 1,
+  SHM_END_OF_STREAM = 2,
+  // Fills the end of the data area when the next record doesn't fit there.
+  SHM_PADDING = 3
+};
+
+/**
+ * Start of the shared memory: ring parameters and positions. Positions count bytes since the start and never wrap,
+ * the offset in the data area is position & (capacity - 1).
+ */
+struct ShmRingHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t capacity;
+  uint32_t sampleRate;
+  uint32_t channels;
+  uint32_t dataOffset;
+  // Writer reserves space before it writes a record and publishes it after. Anything older than reserved - capacity may be overwritten.
+  alignas(64) atomic<uint64_t> reservedPosition;
+  atomic<uint64_t> writePosition;
+  // Futex word bumped on each publish. The writer only makes the wake syscall when someone waits.
+  alignas(64) atomic<uint32_t> sequence;
+  atomic<uint32_t> waiters;
+};
+
+/**
+ * Record in the data area, aligned to 8 bytes and followed by size bytes of payload (16-bit samples for audio).
+ * Records never wrap around the end of the data area.
+ */
+struct ShmRecord
+{
+  uint32_t size;
+  uint16_t kind;
+  int16_t direction;
+  uint32_t utterance;
+  uint32_t reserved;
+  // CLOCK_MONOTONIC
+  int64_t captureTimeNs;
+};
+
+/**
+ * Single writer side of a memfd-backed audio ring. Readers connect to a Unix domain socket, receive the memfd
+ * and read records right from the mapping: nothing is copied per reader, and the writer never waits for them.
+ * A reader which falls behind by more than the capacity detects the overrun and skips to the latest record.
+ * Writes are no-ops until the ring is opened. Not thread safe: called from the audio loop only.
+ */
+class ShmAudioRing
+{
+private:
+  string socketPath;
+  size_t capacity;
+  int memFd;
+  int listenFd;
+  size_t mappingSize;
+  ShmRingHeader *header;
+  char *data;
+  uint32_t utterance;
+  int direction;
+  TimePoint nextAcceptTime;
+
+  void write(ShmRecordKind kind, const char *payload, size_t size, TimePoint captureTime);
+  void publish(uint64_t position);
+
+public:
+  ShmAudioRing(const string &socketPath, size_t capacity);
+  ~ShmAudioRing();
+  bool open(int sampleRate, int channels);
+  void close();
+  void acceptReaders();
+  void send(const AudioChunk &audioChunk);
+  void send(const AudioView &audio, TimePoint captureTime);
+  void startOfStream(int direction);
+  void endOfStream();
+};
+
+/**
+ * Reader side, for consumers written in C++. A returned record points into the shared mapping:
+ * its payload is only trusted if isValid() still returns true after it has been consumed.
+ */
+class ShmAudioReader
+{
+private:
+  int memFd;
+  size_t mappingSize;
+  ShmRingHeader *header;
+  const char *data;
+  uint64_t position;
+  uint64_t recordPosition;
+  uint64_t overruns;
+
+public:
+  ShmAudioReader();
+  ~ShmAudioReader();
+  bool connect(const string &socketPath);
+  void close();
+  const ShmRecord *next(chrono::milliseconds timeout);
+  bool isValid();
+  uint64_t overrunCount();
+  const ShmRingHeader *ring();
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef SOCKET_TRANSPORT_HPP
+#define SOCKET_TRANSPORT_HPP
+
+#define TRANSPORT_CONNECTION_TIMEOUT 5000
+#define TRANSPORT_SEND_TIMEOUT 1000
+#define TRANSPORT_RECEIVE_BUFFER 4096
+#define TRANSPORT_MAX_MESSAGE 1048576
+#define UDP_MAX_PAYLOAD 65000
+#define UDP_HELLO_INTERVAL 250
+#define UDP_HELLO_MESSAGE "{\"hello\" : 1}"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "transport.hpp"
+
+using namespace std;
+
+enum TransportMessageType
+{
+  TRANSPORT_BINARY = 1,
+  TRANSPORT_TEXT = 2
+};
+
+/**
+ * Plain socket link: a receiver thread connects, reads server messages until the connection is over, and is woken up by
+ * an eventfd to stop. Sends come from the ASR client's sender thread and may block for up to TRANSPORT_SEND_TIMEOUT.
+ */
+class SocketTransport : public Transport
+{
+private:
+  int socketType;
+  int stopFd;
+  thread receiver;
+
+  void run();
+  int connectSocket();
+  bool waitForSocket(int socket, short events, int timeout);
+
+protected:
+  TransportAddress address;
+  // Changed by the receiver thread under the send mutex, so a send never hits a closed descriptor.
+  int fd;
+  mutex sendMutex;
+
+  bool waitReadable(int timeout = -1);
+  bool isStopRequested();
+  virtual bool handshake();
+  virtual void receive() = 0;
+
+public:
+  SocketTransport(const TransportAddress &address, int socketType);
+  ~SocketTransport();
+  void start();
+  void stop();
+};
+
+/**
+ * Length-prefixed messages over TCP (tcp://host:port) or a Unix domain socket (unix:///path/to/socket), both ways:
+ * u32 little-endian length of the rest, u8 message type (1 binary, 2 text), then the payload.
+ */
+class StreamTransport : public SocketTransport
+{
+private:
+  string buffer;
+
+  bool sendMessage(TransportMessageType type, const string &payload);
+  void receive();
+
+public:
+  StreamTransport(const TransportAddress &address);
+  ~StreamTransport();
+  string name();
+  bool sendBinary(const string &payload);
+  bool sendText(const string &text);
+};
+
+/**
+ * UDP datagrams (udp://host:port), both ways: u8 message type (1 binary, 2 text), then the payload.
+ * Nothing is retransmitted, and frames longer than UDP_MAX_PAYLOAD are split into several datagrams.
+ * The link is open once the server answers a hello, and over when the server's host reports its port unreachable.
+ */
+class DatagramTransport : public SocketTransport
+{
+private:
+  vector<char> datagram;
+
+  bool sendDatagram(TransportMessageType type, const char *payload, size_t size);
+  bool handshake();
+  void receive();
+
+public:
+  DatagramTransport(const TransportAddress &address);
+  ~DatagramTransport();
+  string name();
+  bool sendBinary(const string &payload);
+  bool sendText(const string &text);
+};
+
+#endif
@@ -3,6 +3,41 @@
 
 #include "common.h"
 
-void state_machine_update(void);
+#define DEFAULT_FRAME_RATE 50
+
+/**
+ * @brief: Start the LED render thread. It keeps running animations until stopped.
+ *
+ * @returns: -1\ On Error
+ *            0\ On Success
+ */
+int state_machine_start(void);
+
+/**
+ * @brief: Request a new animation state. Never blocks: the latest request wins and the render thread picks it up
+ *         before its next frame. Safe to call from a signal handler.
+ */
+void state_machine_post(STATE state);
+
+/**
+ * @brief: Publish the latest direction of arrival (degrees) for the indicator. Never blocks, older values are overwritten.
+ */
+void state_machine_post_direction(int degrees);
+
+/**
+ * @brief: The latest published direction of arrival, or -1 when there's none yet.
+ */
+int state_machine_direction(void);
+
+/**
+ * @brief: Hand new LED settings over to the render thread, which takes ownership of the malloc'ed struct and its keyframes.
+ *         Never blocks: settings which weren't picked up yet are replaced. The current animation restarts with them.
+ */
+void state_machine_post_settings(LED_SETTINGS *settings);
+
+/**
+ * @brief: Stop the render thread, clear LEDs and log state change latencies and SPI traffic.
+ */
+void state_machine_stop(void);
 
 #endif
@@ -0,0 +1,53 @@
+#ifndef TRANSCRIPT_PUBLISHER_HPP
+#define TRANSCRIPT_PUBLISHER_HPP
+
+#define TRANSCRIPT_BACKLOG 8
+#define TRANSCRIPT_SEND_BUFFER 262144
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "asr_response.hpp"
+
+using namespace std;
+
+enum TranscriptEventType
+{
+  TRANSCRIPT_PARTIAL = 1,
+  TRANSCRIPT_FINAL = 2
+};
+
+/**
+ * Streams transcripts to local consumers over a Unix domain socket. Each event is a frame of little-endian fields:
+ * u32 length of the rest, u8 type, u32 utterance id, i16 direction of arrival, u16 text length + UTF-8 text,
+ * and for a final transcribe: u16 word count, then per word f32 start, f32 end, f32 confidence, u16 length + UTF-8 word.
+ *
+ * Publishing never blocks: consumers are accepted lazily, and a consumer which can't take a whole frame is dropped.
+ * Not thread safe: events are published from the transport's callback thread only.
+ */
+class TranscriptPublisher
+{
+private:
+  string path;
+  int listenFd;
+  vector<int> consumers;
+  string frame;
+
+  void acceptConsumers();
+  void beginFrame(TranscriptEventType type, uint32_t utterance, int direction);
+  void appendInt(uint32_t value, int bytes);
+  void appendFloat(double value);
+  void appendText(const string &text);
+  void broadcast();
+
+public:
+  TranscriptPublisher(const string &path);
+  ~TranscriptPublisher();
+  bool open();
+  void close();
+  void publishPartial(uint32_t utterance, int direction, const string &partial);
+  void publishFinal(uint32_t utterance, int direction, const AsrResponse &response);
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef TRANSPORT_HPP
+#define TRANSPORT_HPP
+
+#include <functional>
+#include <memory>
+#include <string>
+
+using namespace std;
+
+/**
+ * Parsed ASR server address: ws://host:port/path, wss://..., tcp://host:port, udp://host:port or unix:///path/to/socket.
+ */
+struct TransportAddress
+{
+  string scheme;
+  string host;
+  int port;
+  // Socket file for unix://, request path for ws:// and wss://.
+  string path;
+
+  static bool parse(const string &url, TransportAddress &address);
+};
+
+/**
+ * Message oriented link to the ASR server: binary messages carry audio frames, text messages carry JSON
+ * (stream config, EOF and responses). Connection is established in background; callbacks come from the transport's own thread,
+ * and never after stop() has returned. A stopped transport could be started again to reconnect.
+ */
+class Transport
+{
+protected:
+  function<void()> onOpen;
+  function<void()> onClose;
+  function<void(const string &)> onMessage;
+
+public:
+  virtual ~Transport() {}
+  void setCallbacks(function<void()> onOpen, function<void()> onClose, function<void(const string &)> onMessage);
+  virtual string name() = 0;
+  virtual void start() = 0;
+  virtual void stop() = 0;
+  virtual bool sendBinary(const string &payload) = 0;
+  virtual bool sendText(const string &text) = 0;
+};
+
+/**
+ * Create transport which matches the address scheme. Returns nullptr for an unsupported or malformed address.
+ */
+unique_ptr<Transport> createTransport(const string &url);
+
+#endif
@@ -19,6 +19,10 @@
 #define LIGHT_GRAY "\033[0;37m"
 #define WHITE "\033[1;37m"
 
+#define LOG_MSG_MAX 512
+#define LOG_QUEUE_SIZE 64
+#define LOG_WRITER_TIMEOUT_MS 200
+
 typedef enum
 {
     V_NORMAL = 0,
@@ -26,8 +30,56 @@ typedef enum
     VVV_DEBUG
 } VERBOSE;
 
+typedef enum
+{
+    VERBOSE_TEXT = 0,
+    VERBOSE_JSON
+} VERBOSE_FORMAT;
+
+typedef struct
+{
+    int64_t last_ms;
+    unsigned int suppressed;
+} VERBOSE_RATE_LIMIT;
+
+/**
+ * @brief: Log a message. Once the writer thread is started, the message is only formatted by the calling thread
+ *         and put into its own lock-free queue, so logging never blocks on I/O. Messages are dropped when the queue is full.
+ *
+ * @returns: length of the formatted message
+ */
 int verbose(VERBOSE lvl, FILE *stream, const char * __restrict__ format, ...);
 
+/**
+ * @brief: Log a message not more often than once per interval. Use verbose_rl() for hot paths.
+ */
+int verbose_rate_limited(VERBOSE_RATE_LIMIT *limit, int interval_ms, VERBOSE lvl, FILE *stream, const char * __restrict__ format, ...);
+
+#define verbose_rl(interval_ms, lvl, stream, ...)                                 \
+    do                                                                            \
+    {                                                                             \
+        static VERBOSE_RATE_LIMIT _verbose_limit = {0, 0};                        \
+        verbose_rate_limited(&_verbose_limit, interval_ms, lvl, stream, __VA_ARGS__); \
+    } while (0)
+
 void setVerbose(VERBOSE lvl);
 
+/**
+ * @brief: Plain text lines (with colours) or JSON lines
+ */
+void setVerboseFormat(VERBOSE_FORMAT format);
+
+/**
+ * @brief: Start background writer thread. Until then messages are written synchronously.
+ *
+ * @returns: -1\ On Error
+ *            0\ On Success
+ */
+int verbose_start(void);
+
+/**
+ * @brief: Write out pending messages and stop the writer thread.
+ */
+void verbose_stop(void);
+
 #endif
@@ -0,0 +1,38 @@
+#ifndef VOICE_ACTIVITY_DETECTOR_HPP
+#define VOICE_ACTIVITY_DETECTOR_HPP
+
+#define VAD_MIN_SPEECH_MS 64
+#define VAD_MIN_LEVEL_DB 30.0
+#define VAD_FLOOR_RISE 0.01
+#define VAD_FLOOR_FALL 0.5
+
+#include "audio_chunk.hpp"
+
+/**
+ * Energy based voice activity detector working on processed (AGC'ed) blocks.
+ * Speech is a block which is louder than an adaptive noise floor by a given threshold.
+ * An utterance ends when speech was heard and it's followed by the trailing silence.
+ */
+class VoiceActivityDetector
+{
+private:
+  double threshold;
+  int trailingSilence;
+  int blockMs;
+  double noiseFloor;
+  bool isFloorKnown;
+
+  int speechMs;
+  int silenceMs;
+  bool hasSpeech;
+  TimePoint speechEndTime;
+
+public:
+  VoiceActivityDetector(double threshold, int trailingSilence, int blockMs);
+  bool process(const AudioChunk &chunk);
+  void reset();
+  bool isUtteranceEnded();
+  TimePoint lastSpeechTime();
+};
+
+#endif
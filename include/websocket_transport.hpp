@@ -0,0 +1,30 @@
+#ifndef WEBSOCKET_TRANSPORT_HPP
+#define WEBSOCKET_TRANSPORT_HPP
+
+#define WS_PING_INTERVAL 45
+
+/**
+ * See WebSocket docs: https://machinezone.github.io/IXWebSocket/
+ */
+#include <ixwebsocket/IXWebSocket.h>
+#include "transport.hpp"
+
+/**
+ * WS connection to a Vosk-like server, e.g. ws://127.0.0.1:2700.
+ */
+class WebSocketTransport : public Transport
+{
+private:
+  ix::WebSocket client;
+  string url;
+
+public:
+  WebSocketTransport(const string &url);
+  string name();
+  void start();
+  void stop();
+  bool sendBinary(const string &payload);
+  bool sendText(const string &text);
+};
+
+#endif
@@ -1,220 +1,283 @@
 #include "animation.h"
 #include "cAPA102.h"
+#include "state_handler.h"
 #include "verbose.h"
 
+#include <math.h>
+
+#define LEVEL_STEP ((LUT_SIZE - 1) / STEP_COUNT)
+
 extern RUNTIME_OPTIONS RUNTIME;
 
-/* @brief: Consider that each color has 255 level brightness,
- *         this function remap the origin rgb value to a certain
- *         level of brightness.
- */
-static uint32_t remap_4byte(uint32_t color, uint8_t brightness)
+/* Colour of each fade level, brightness and gamma already applied */
+static struct
+{
+    uint32_t idle[LUT_SIZE];
+    uint32_t listen[LUT_SIZE];
+    uint32_t speak[LUT_SIZE];
+    uint32_t mute[LUT_SIZE];
+    uint32_t unmute[LUT_SIZE];
+} LUT;
+
+static void build_lut(uint32_t *lut, uint32_t colour)
 {
     uint8_t r, g, b;
+    double scale;
 
-    r = (uint8_t)((color >> 16) * brightness / 255);
-    g = (uint8_t)((color >> 8) * brightness / 255);
-    b = (uint8_t)(color * brightness / 255);
+    for (int level = 0; level < LUT_SIZE; level++)
+    {
+        scale = pow((double)level / (LUT_SIZE - 1), GAMMA) * RUNTIME.max_brightness / 255;
+        r = (uint8_t)(((colour >> 16) & 0xFF) * scale + 0.5);
+        g = (uint8_t)(((colour >> 8) & 0xFF) * scale + 0.5);
+        b = (uint8_t)((colour & 0xFF) * scale + 0.5);
+        lut[level] = (r << 16) | (g << 8) | b;
+    }
+}
 
-    return (r << 16) | (g << 8) | b;
+void build_colour_luts(void)
+{
+    build_lut(LUT.idle, RUNTIME.animation_color.idle);
+    build_lut(LUT.listen, RUNTIME.animation_color.listen);
+    build_lut(LUT.speak, RUNTIME.animation_color.speak);
+    build_lut(LUT.mute, RUNTIME.animation_color.mute);
+    build_lut(LUT.unmute, RUNTIME.animation_color.unmute);
 }
 
-static void delay_on_state(int ms, int state)
+/* @brief: Render the next frame of a fade in / fade out cycle of the whole ring.
+ *
+ * @returns: 1 when the cycle is over and nothing was rendered
+ */
+static int fade_all(ANIMATION_CTX *ctx, const uint32_t *lut)
 {
-    for (int j = 0; j < ms && RUNTIME.curr_state == state; j++)
-        usleep(1000);
+    if (!ctx->fading_out)
+    {
+        cAPA102_Fill_4byte(lut[ctx->level]);
+        cAPA102_Refresh();
+        ctx->level += LEVEL_STEP;
+        if (ctx->level >= LUT_SIZE - 1)
+        {
+            ctx->level = LUT_SIZE - 1;
+            ctx->fading_out = 1;
+        }
+        return 0;
+    }
+
+    if (ctx->level > 0)
+    {
+        cAPA102_Fill_4byte(lut[ctx->level]);
+        cAPA102_Refresh();
+        ctx->level -= LEVEL_STEP;
+        return 0;
+    }
+
+    ctx->level = 0;
+    ctx->fading_out = 0;
+    return 1;
 }
 
 // 0
-void *on_idle()
+int on_idle(ANIMATION_CTX *ctx)
 {
-    int curr_bri = 0;
-    uint8_t led, step;
-    verbose(VVV_DEBUG, stdout, PURPLE "[%s]" NONE " animation started", __FUNCTION__);
-    RUNTIME.if_update = 0;
-    cAPA102_Clear_All();
-    srand((unsigned int)time(NULL));
-
-    step = RUNTIME.max_brightness / STEP_COUNT;
-    while (RUNTIME.curr_state == ON_IDLE)
+    switch (ctx->phase)
     {
-        delay_on_state(2000, ON_IDLE);
+    case 0:
+        verbose(VVV_DEBUG, stdout, PURPLE "[%s]" NONE " animation started", __FUNCTION__);
+        srand((unsigned int)time(NULL));
+        ctx->phase = 1;
+        /* fall through */
+    case 1:
         cAPA102_Clear_All();
-        led = rand() % RUNTIME.LEDs.number;
-
-        for (curr_bri = 0; curr_bri < RUNTIME.max_brightness &&
-                           RUNTIME.curr_state == ON_IDLE;
-             curr_bri += step)
+        ctx->phase = 2;
+        return 2000;
+    case 2:
+        cAPA102_Clear_All();
+        ctx->led = rand() % RUNTIME.LEDs.number;
+        ctx->level = 0;
+        ctx->phase = 3;
+        /* fall through */
+    case 3:
+        cAPA102_Set_Pixel_4byte(ctx->led, LUT.idle[ctx->level]);
+        cAPA102_Refresh();
+        ctx->level += LEVEL_STEP;
+        if (ctx->level >= LUT_SIZE - 1)
         {
-            cAPA102_Set_Pixel_4byte(led, remap_4byte(RUNTIME.animation_color.idle, curr_bri));
-            cAPA102_Refresh();
-            delay_on_state(100, ON_IDLE);
+            ctx->level = LUT_SIZE - 1;
+            ctx->phase = 4;
         }
-        curr_bri = RUNTIME.max_brightness;
-        for (curr_bri = RUNTIME.max_brightness; curr_bri > 0 &&
-                                                 RUNTIME.curr_state == ON_IDLE;
-             curr_bri -= step)
+        return 100;
+    default:
+        if (ctx->level > 0)
         {
-            cAPA102_Set_Pixel_4byte(led, remap_4byte(RUNTIME.animation_color.idle, curr_bri));
+            cAPA102_Set_Pixel_4byte(ctx->led, LUT.idle[ctx->level]);
             cAPA102_Refresh();
-            delay_on_state(100, ON_IDLE);
+            ctx->level -= LEVEL_STEP;
+            return 100;
         }
-        cAPA102_Set_Pixel_4byte(led, 0);
+        cAPA102_Set_Pixel_4byte(ctx->led, 0);
         cAPA102_Refresh();
-        delay_on_state(3000, ON_IDLE);
+        ctx->phase = 1;
+        return 3000;
     }
-    cAPA102_Clear_All();
-    return ((void *)"ON_IDLE");
 }
 
 // 1
-void *on_listen()
+int on_listen(ANIMATION_CTX *ctx)
 {
-    uint8_t i, g, group;
-    verbose(VVV_DEBUG, stdout, PURPLE "[%s]" NONE " animation started", __FUNCTION__);
-    RUNTIME.if_update = 0;
-    cAPA102_Clear_All();
-    group = RUNTIME.LEDs.number / 3;
-    while (RUNTIME.curr_state == ON_LISTEN)
+    switch (ctx->phase)
     {
-        for (i = 0; i < 3 && RUNTIME.curr_state == ON_LISTEN; i++)
-        {
-            for (g = 0; g < group && RUNTIME.curr_state == ON_LISTEN; g++)
-                cAPA102_Set_Pixel_4byte(g * 3 + i, remap_4byte(RUNTIME.animation_color.listen, RUNTIME.max_brightness));
-            cAPA102_Refresh();
-            delay_on_state(80, ON_LISTEN);
-            cAPA102_Clear_All();
-            delay_on_state(80, ON_LISTEN);
-        }
+    case 0:
+        verbose(VVV_DEBUG, stdout, PURPLE "[%s]" NONE " animation started", __FUNCTION__);
+        cAPA102_Clear_All();
+        ctx->group = 0;
+        ctx->phase = 1;
+        /* fall through */
+    case 1:
+        for (uint8_t g = 0; g < RUNTIME.LEDs.number / 3; g++)
+            cAPA102_Set_Pixel_4byte(g * 3 + ctx->group, LUT.listen[LUT_SIZE - 1]);
+        cAPA102_Refresh();
+        ctx->phase = 2;
+        return 80;
+    default:
+        cAPA102_Clear_All();
+        ctx->group = (ctx->group + 1) % 3;
+        ctx->phase = 1;
+        return 80;
     }
-    cAPA102_Clear_All();
-    return ((void *)"ON_LISTEN");
 }
 
 // 2
-void *on_speak()
+int on_speak(ANIMATION_CTX *ctx)
 {
-    uint8_t j;
-    uint8_t step;
-    int curr_bri = 0;
-    verbose(VVV_DEBUG, stdout, PURPLE "[%s]" NONE " animation started", __FUNCTION__);
-    RUNTIME.if_update = 0;
-    cAPA102_Clear_All();
+    if (0 == ctx->phase)
+    {
+        verbose(VVV_DEBUG, stdout, PURPLE "[%s]" NONE " animation started", __FUNCTION__);
+        cAPA102_Clear_All();
+        ctx->phase = 1;
+    }
 
-    step = RUNTIME.max_brightness / STEP_COUNT;
-    while (RUNTIME.curr_state == ON_SPEAK)
+    if (fade_all(ctx, LUT.speak))
     {
-        for (curr_bri = 0; curr_bri < RUNTIME.max_brightness &&
-                           RUNTIME.curr_state == ON_SPEAK;
-             curr_bri += step)
-        {
-            for (j = 0; j < RUNTIME.LEDs.number && RUNTIME.curr_state == ON_SPEAK; j++)
-                cAPA102_Set_Pixel_4byte(j, remap_4byte(RUNTIME.animation_color.speak, curr_bri));
-            cAPA102_Refresh();
-            delay_on_state(20, ON_SPEAK);
-        }
-        curr_bri = RUNTIME.max_brightness;
-        for (curr_bri = RUNTIME.max_brightness; curr_bri > 0 &&
-                                                 RUNTIME.curr_state == ON_SPEAK;
-             curr_bri -= step)
-        {
-            for (j = 0; j < RUNTIME.LEDs.number && RUNTIME.curr_state == ON_SPEAK; j++)
-                cAPA102_Set_Pixel_4byte(j, remap_4byte(RUNTIME.animation_color.speak, curr_bri));
-            cAPA102_Refresh();
-            delay_on_state(20, ON_SPEAK);
-        }
         cAPA102_Clear_All();
-        cAPA102_Refresh();
-        delay_on_state(200, ON_SPEAK);
+        return 200;
     }
-    cAPA102_Clear_All();
-    return ((void *)"ON_SPEAK");
+    return 20;
 }
 
 // 3
-void *to_mute()
+int to_mute(ANIMATION_CTX *ctx)
 {
-    uint8_t j;
-    uint8_t step;
-    int curr_bri = 0;
-    verbose(VVV_DEBUG, stdout, PURPLE "[%s]" NONE " animation started", __FUNCTION__);
-    RUNTIME.if_update = 0;
-    cAPA102_Clear_All();
+    if (0 == ctx->phase)
+    {
+        verbose(VVV_DEBUG, stdout, PURPLE "[%s]" NONE " animation started", __FUNCTION__);
+        cAPA102_Clear_All();
+        ctx->phase = 1;
+    }
 
-    step = RUNTIME.max_brightness / STEP_COUNT;
-    for (curr_bri = 0; curr_bri < RUNTIME.max_brightness && RUNTIME.curr_state == TO_MUTE; curr_bri += step)
+    if (fade_all(ctx, LUT.mute))
     {
-        for (j = 0; j < RUNTIME.LEDs.number && RUNTIME.curr_state == TO_MUTE; j++)
-            cAPA102_Set_Pixel_4byte(j, remap_4byte(RUNTIME.animation_color.mute, curr_bri));
-        cAPA102_Refresh();
-        delay_on_state(50, TO_MUTE);
+        cAPA102_Clear_All();
+        return ANIMATION_DONE;
     }
-    curr_bri = RUNTIME.max_brightness;
-    for (curr_bri = RUNTIME.max_brightness; curr_bri > 0 && RUNTIME.curr_state == TO_MUTE; curr_bri -= step)
+    return 50;
+}
+
+// 4
+int to_unmute(ANIMATION_CTX *ctx)
+{
+    if (0 == ctx->phase)
     {
-        for (j = 0; j < RUNTIME.LEDs.number && RUNTIME.curr_state == TO_MUTE; j++)
-            cAPA102_Set_Pixel_4byte(j, remap_4byte(RUNTIME.animation_color.mute, curr_bri));
-        cAPA102_Refresh();
-        delay_on_state(50, TO_MUTE);
+        verbose(VVV_DEBUG, stdout, PURPLE "[%s]" NONE " animation started", __FUNCTION__);
+        cAPA102_Clear_All();
+        ctx->phase = 1;
     }
-    cAPA102_Clear_All();
-    cAPA102_Refresh();
-    if (TO_MUTE == RUNTIME.curr_state)
+
+    if (fade_all(ctx, LUT.unmute))
     {
-        RUNTIME.curr_state = ON_IDLE;
-        RUNTIME.if_update = 1;
+        cAPA102_Clear_All();
+        return ANIMATION_DONE;
     }
-    cAPA102_Clear_All();
-    return ((void *)"TO_MUTE");
+    return 50;
 }
 
-// 4
-void *to_unmute()
+// 5
+int on_disabled(ANIMATION_CTX *ctx)
 {
-    uint8_t j;
-    uint8_t step;
-    int curr_bri = 0;
+    (void)ctx;
     verbose(VVV_DEBUG, stdout, PURPLE "[%s]" NONE " animation started", __FUNCTION__);
-    RUNTIME.if_update = 0;
     cAPA102_Clear_All();
+    return ANIMATION_WAIT;
+}
 
-    step = RUNTIME.max_brightness / STEP_COUNT;
-    for (curr_bri = 0; curr_bri < RUNTIME.max_brightness && RUNTIME.curr_state == TO_UNMUTE; curr_bri += step)
+int on_direction(ANIMATION_CTX *ctx)
+{
+    int direction = state_machine_direction();
+    int frame_ms = 1000 / (RUNTIME.frame_rate > 0 ? RUNTIME.frame_rate : DEFAULT_FRAME_RATE);
+    double angle, position, weight;
+    int led;
+
+    if (0 == ctx->phase)
     {
-        for (j = 0; j < RUNTIME.LEDs.number && RUNTIME.curr_state == TO_UNMUTE; j++)
-            cAPA102_Set_Pixel_4byte(j, remap_4byte(RUNTIME.animation_color.unmute, curr_bri));
-        cAPA102_Refresh();
-        delay_on_state(50, TO_UNMUTE);
+        verbose(VVV_DEBUG, stdout, PURPLE "[%s]" NONE " animation started", __FUNCTION__);
+        cAPA102_Clear_All();
+        ctx->phase = 1;
     }
-    curr_bri = RUNTIME.max_brightness;
-    for (curr_bri = RUNTIME.max_brightness; curr_bri > 0 && RUNTIME.curr_state == TO_UNMUTE; curr_bri -= step)
+
+    if (direction < 0)
+        return frame_ms;
+
+    /* Angles are smoothed as unit vectors, so going over 0 / 360 doesn't swing the light around the ring */
+    angle = direction * M_PI / 180;
+    if (1 == ctx->phase)
     {
-        for (j = 0; j < RUNTIME.LEDs.number && RUNTIME.curr_state == TO_UNMUTE; j++)
-            cAPA102_Set_Pixel_4byte(j, remap_4byte(RUNTIME.animation_color.unmute, curr_bri));
-        cAPA102_Refresh();
-        delay_on_state(50, TO_UNMUTE);
+        ctx->x = cos(angle);
+        ctx->y = sin(angle);
+        ctx->phase = 2;
     }
-    cAPA102_Clear_All();
-    cAPA102_Refresh();
-    if (TO_UNMUTE == RUNTIME.curr_state)
+    else
     {
-        RUNTIME.curr_state = ON_IDLE;
-        RUNTIME.if_update = 1;
+        ctx->x += RUNTIME.doa_smoothing * (cos(angle) - ctx->x);
+        ctx->y += RUNTIME.doa_smoothing * (sin(angle) - ctx->y);
     }
-    cAPA102_Clear_All();
-    return ((void *)"TO_UNMUTE");
+
+    /* The light is split between two neighbour LEDs according to the distance */
+    position = fmod(atan2(ctx->y, ctx->x) * 180 / M_PI + 360, 360) / 360 * RUNTIME.LEDs.number;
+    led = (int)position % RUNTIME.LEDs.number;
+    weight = position - floor(position);
+    for (int j = 0; j < RUNTIME.LEDs.number; j++)
+    {
+        if (j == led)
+            cAPA102_Set_Pixel_4byte(j, LUT.listen[(int)((1 - weight) * (LUT_SIZE - 1) + 0.5)]);
+        else if (j == (led + 1) % RUNTIME.LEDs.number)
+            cAPA102_Set_Pixel_4byte(j, LUT.listen[(int)(weight * (LUT_SIZE - 1) + 0.5)]);
+        else
+            cAPA102_Set_Pixel_4byte(j, 0);
+    }
+    /* Nothing is sent once the light settles */
+    cAPA102_Refresh();
+    return frame_ms;
 }
 
-// 5
-void *on_disabled()
+int play_keyframes(ANIMATION_CTX *ctx)
 {
-    verbose(VVV_DEBUG, stdout, PURPLE "[%s]" NONE " animation started", __FUNCTION__);
-    RUNTIME.if_update = 0;
-    while (RUNTIME.curr_state == ON_DISABLED)
+    const KEYFRAME_ANIMATION *keyframes = ctx->keyframes;
+
+    if (ctx->phase >= (int)keyframes->frame_count)
     {
-        cAPA102_Clear_All();
-        delay_on_state(100, ON_DISABLED);
+        if (!keyframes->loop)
+            return ANIMATION_DONE;
+        ctx->phase = 0;
     }
-    cAPA102_Clear_All();
-    return ((void *)"ON_DISABLED");
+
+    cAPA102_Load_Frame(keyframes->frames + ctx->phase * keyframes->frame_size);
+    cAPA102_Refresh();
+    ctx->phase++;
+    return keyframes->frame_ms;
+}
+
+void free_keyframes(KEYFRAME_ANIMATION *keyframes)
+{
+    if (NULL == keyframes)
+        return;
+    free(keyframes->frames);
+    free(keyframes);
 }
@@ -0,0 +1,584 @@
+#include "asr_client.hpp"
+
+AsrClient::AsrClient(Config *config, LatencyTracker *latencyTracker, size_t blockBytes, int rate, int channels)
+    : queue(config->queueDepth(), textToOverflowPolicy(config->overflowPolicy()), blockBytes)
+{
+  this->latencyTracker = latencyTracker;
+  _isTranscribeReceived = false;
+  isTranscribePending = false;
+  transcribeTime = 0;
+  _isConnected = false;
+  this->rate = rate;
+  encoder = createAudioEncoder(config->codec(), rate, channels, config->bitrate());
+  encodedBlocks = 0;
+  encoderInputBytes = 0;
+  encoderOutputBytes = 0;
+  encodeMicros = 0;
+
+  size_t bytesPerMs = rate / 1000 * channels * sizeof(int16_t);
+  batchAudioBytes = config->batchDuration() * bytesPerMs;
+  batchBytes = config->batchSize();
+  maxLatency = chrono::milliseconds(config->maxLatency());
+  frameAudioBytes = 0;
+  sentFrames = 0;
+  sentBytes = 0;
+
+  isStarted = false;
+  wasConnected = false;
+  wasEverConnected = false;
+  reconnectAttempts = 0;
+  reconnectMinDelay = chrono::milliseconds(config->reconnectMinDelay());
+  reconnectMaxDelay = chrono::milliseconds(config->reconnectMaxDelay());
+  random.seed(random_device()());
+  replayBufferSize = config->replayBufferSize();
+  replayBuffer.reserve(replayBufferSize);
+  listeningTimeout = chrono::milliseconds(config->listeningTimeout());
+  isUtteranceActive = false;
+  isUtteranceEnded = false;
+  isEofSent = false;
+  finalResults = 0;
+  eofFinalResults = 0;
+  isReplayable = false;
+  isUtteranceDropped = false;
+  reconnects = 0;
+  bufferedBytes = 0;
+  peakBufferedBytes = 0;
+  droppedUtterances = 0;
+
+  utteranceId = 0;
+  utteranceDirection = -1;
+  startDirection = -1;
+  utteranceResultBase = 0;
+  if (!config->transcriptSocketPath().empty())
+  {
+    publisher.reset(new TranscriptPublisher(config->transcriptSocketPath()));
+    if (!publisher->open())
+    {
+      publisher.reset();
+    }
+  }
+
+  isSending = true;
+  sender = thread(&AsrClient::sendQueuedAudio, this, blockBytes);
+}
+
+/**
+ * Connection is established in background, so that it overlaps with the rest of startup. Audio sent before that is buffered.
+ */
+void AsrClient::connect(const string &address)
+{
+  transport = createTransport(address);
+  if (transport == nullptr)
+  {
+    return;
+  }
+  transport->setCallbacks([this]() { this->handleOpen(); }, [this]() { this->handleClose(); },
+                          [this](const string &message) { this->handleMessage(message); });
+
+  connectTime = SteadyClock::now();
+  nextReconnectTime = connectTime + chrono::milliseconds(ASR_CONNECTION_TIMEOUT);
+  transport->start();
+  isStarted = true;
+}
+
+void AsrClient::handleMessage(const string &message)
+{
+  if (!responseParser.parse(message, response))
+  {
+    verbose_rl(5000, V_NORMAL, stderr, "Malformed ASR server response: %.100s", message.c_str());
+    return;
+  }
+
+  // Even an empty final result answers the EOF: the server is done with the utterance.
+  uint64_t results = response.hasResult ? finalResults++ : finalResults.load();
+
+  // Responses still due for the previous utterance, e.g. the answer to its EOF after it has timed out, don't belong to the current one.
+  uint32_t id = utteranceId.load(memory_order_acquire);
+  if (results < utteranceResultBase.load(memory_order_relaxed))
+  {
+    verbose_rl(5000, VVV_DEBUG, stdout, "Dropped a late response of the previous utterance");
+    return;
+  }
+
+  if (!response.partial.empty())
+  {
+    latencyTracker->mark(FIRST_PARTIAL);
+
+    // Vosk repeats a partial until the hypothesis changes.
+    if (publisher != nullptr && response.partial != lastPartial)
+    {
+      publisher->publishPartial(id, utteranceDirection.load(memory_order_relaxed), response.partial);
+      lastPartial.assign(response.partial);
+    }
+  }
+
+  // When we receive a final transcibe from Vosk server, it'll contain "result" and "text" props.
+  if (response.hasResult && !response.text.empty())
+  {
+    if (publisher != nullptr)
+    {
+      publisher->publishFinal(id, utteranceDirection.load(memory_order_relaxed), response);
+      lastPartial.clear();
+    }
+    if (response.confidence >= 0)
+    {
+      verbose(VV_INFO, stdout, "Transcribe: %s (%d words, confidence = %.2f)", response.text.c_str(), (int)response.words.size(), response.confidence);
+    }
+    else
+    {
+      verbose(VV_INFO, stdout, "Transcribe: %s", response.text.c_str());
+    }
+    transcribeTime.store(SteadyClock::now().time_since_epoch().count(), memory_order_relaxed);
+    latencyTracker->mark(FINAL_RESULT);
+    _isTranscribeReceived = true;
+    isTranscribePending.store(true, memory_order_release);
+  }
+}
+
+void AsrClient::handleOpen()
+{
+  verbose(VV_INFO, stdout, "Connected to ASR server over %s", transport->name().c_str());
+  // Nothing is due from the previous connection.
+  utteranceResultBase = finalResults.load();
+  sendStreamConfig();
+  _isConnected = true;
+}
+
+/**
+ * Let the server know how to decode the stream. It's repeated before each utterance, as a UDP datagram may be lost.
+ */
+void AsrClient::sendStreamConfig()
+{
+  if (encoder != nullptr)
+  {
+    json header = {{"config", {{"sample_rate", rate}, {"codec", encoder->name()}}}};
+    transport->sendText(header.dump());
+  }
+}
+
+void AsrClient::handleClose()
+{
+  verbose(VV_INFO, stdout, "Disconnected from ASR server");
+  _isConnected = false;
+}
+
+void AsrClient::disconnect()
+{
+  isSending = false;
+  queue.close();
+  if (sender.joinable()) {
+    sender.join();
+  }
+
+  if (isStarted) {
+    transport->stop();
+  }
+
+  // No more callbacks after the transport is stopped.
+  publisher.reset();
+}
+
+/**
+ * Enqueue audio block for sending without copying its samples. Called from the audio thread, never waits for the socket.
+ */
+bool AsrClient::send(AudioChunk &&audioChunk)
+{
+  return queue.push(move(audioChunk));
+}
+
+/**
+ * Enqueue a copy of audio samples owned by the caller. Called from the audio thread, never waits for the socket.
+ */
+bool AsrClient::send(const AudioView &audio)
+{
+  return queue.push(audio);
+}
+
+/**
+ * Enqueue start of utterance marker before its first audio block. Called from the audio thread.
+ * The new utterance id is published by the sender thread, once it's done with the previous utterance.
+ */
+bool AsrClient::startOfStream(int direction)
+{
+  startDirection.store(direction, memory_order_relaxed);
+  return queue.pushMarker(ChunkKind::StartOfStream);
+}
+
+/**
+ * Enqueue end of utterance marker after the audio which is already queued. Called from the audio thread.
+ */
+bool AsrClient::endOfStream()
+{
+  return queue.pushMarker(ChunkKind::EndOfStream);
+}
+
+/**
+ * Sender thread's loop: drain the queue into the socket.
+ */
+void AsrClient::sendQueuedAudio(size_t blockBytes)
+{
+  AudioChunk audioChunk;
+  audioChunk.data.reserve(blockBytes);
+  string encoded;
+  encoded.reserve(blockBytes);
+  frame.reserve(max(batchBytes, batchAudioBytes) + blockBytes);
+
+  while (isSending)
+  {
+    if (isUtteranceActive && isUtteranceAnswered())
+    {
+      finishUtterance();
+    }
+
+    bool connected = _isConnected;
+    if (connected && !wasConnected)
+    {
+      if (wasEverConnected)
+      {
+        reconnects++;
+      }
+      else
+      {
+        verbose(VV_INFO, stdout, "Startup: ASR server is connected in %lld ms.",
+                (long long)chrono::duration_cast<chrono::milliseconds>(SteadyClock::now() - connectTime).count());
+      }
+      wasEverConnected = true;
+      reconnectAttempts = 0;
+      replayUtterance();
+    }
+    else if (!connected && wasConnected)
+    {
+      scheduleReconnect(SteadyClock::now());
+    }
+    wasConnected = connected;
+
+    if (!connected)
+    {
+      reconnectIfDue();
+    }
+
+    // Don't wait for more audio longer than a pending frame is allowed to stay unsent.
+    chrono::milliseconds timeout(connected ? QUEUE_WAIT_TIMEOUT : ASR_RECONNECT_POLL);
+    if (!frame.empty())
+    {
+      timeout = min(timeout, max(chrono::milliseconds(0), chrono::duration_cast<chrono::milliseconds>(frameDeadline - SteadyClock::now())));
+    }
+
+    // Keep draining the queue while disconnected: frames of the current utterance go to the replay buffer.
+    if (queue.waitPop(audioChunk, timeout))
+    {
+      if (audioChunk.kind == ChunkKind::StartOfStream)
+      {
+        startUtterance();
+        if (encoder != nullptr)
+        {
+          encoder->reset();
+        }
+        frame.clear();
+        frameAudioBytes = 0;
+        replayBuffer.clear();
+        replayFrames.clear();
+        bufferedBytes = 0;
+        utteranceStartTime = audioChunk.captureTime;
+        isUtteranceActive = true;
+        isUtteranceEnded = false;
+        isEofSent = false;
+        isReplayable = replayBufferSize > 0;
+        isUtteranceDropped = false;
+        if (wasConnected)
+        {
+          sendStreamConfig();
+        }
+        continue;
+      }
+      else if (audioChunk.kind == ChunkKind::EndOfStream)
+      {
+        // Let the server finalize the transcribe right away, the codec's tail included.
+        if (encoder != nullptr)
+        {
+          encoder->flush(encoded);
+          encoderOutputBytes += encoded.size();
+          appendPayload(encoded, 0, audioChunk.captureTime);
+        }
+        if (!frame.empty())
+        {
+          flushFrame();
+        }
+        isUtteranceEnded = true;
+        if (wasConnected)
+        {
+          sendEof();
+        }
+        continue;
+      }
+      appendAudio(audioChunk, encoded);
+    }
+
+    if (!frame.empty() && SteadyClock::now() >= frameDeadline)
+    {
+      flushFrame();
+    }
+  }
+}
+
+void AsrClient::appendAudio(const AudioChunk &audioChunk, string &encoded)
+{
+  const string *payload = &audioChunk.data;
+
+  if (encoder != nullptr)
+  {
+    TimePoint startTime = SteadyClock::now();
+    encoder->encode(audioChunk.data, encoded);
+    encodeMicros += chrono::duration_cast<chrono::microseconds>(SteadyClock::now() - startTime).count();
+    encodedBlocks++;
+    encoderInputBytes += audioChunk.data.size();
+    encoderOutputBytes += encoded.size();
+    payload = &encoded;
+  }
+  appendPayload(*payload, audioChunk.data.size(), audioChunk.captureTime);
+}
+
+void AsrClient::appendPayload(const string &payload, size_t audioBytes, TimePoint captureTime)
+{
+  // Some codecs need more than one block to produce a frame.
+  if (payload.empty())
+  {
+    return;
+  }
+
+  // Batching is disabled: every block is a separate frame.
+  if (batchAudioBytes == 0 && batchBytes == 0)
+  {
+    sendFrame(payload);
+    return;
+  }
+
+  if (frame.empty())
+  {
+    frameDeadline = captureTime + maxLatency;
+  }
+  frame.append(payload);
+  frameAudioBytes += audioBytes;
+
+  if ((batchAudioBytes > 0 && frameAudioBytes >= batchAudioBytes) || (batchBytes > 0 && frame.size() >= batchBytes))
+  {
+    flushFrame();
+  }
+}
+
+void AsrClient::sendFrame(const string &payload)
+{
+  if (isUtteranceActive)
+  {
+    bufferFrame(payload);
+  }
+
+  // The sender thread's view of the link: a connection opened since the loop has checked it gets the utterance replayed first.
+  if (!wasConnected)
+  {
+    if (isUtteranceActive && !isReplayable)
+    {
+      dropUtterance();
+    }
+    return;
+  }
+
+  transport->sendBinary(payload);
+  latencyTracker->mark(FIRST_SENT);
+  sentFrames++;
+  sentBytes += payload.size();
+}
+
+/**
+ * Keep a copy of the utterance's frame until it ends, so it could be resent after reconnect.
+ */
+void AsrClient::bufferFrame(const string &payload)
+{
+  if (!isReplayable)
+  {
+    return;
+  }
+
+  // Utterance is too long to keep it in memory: give up on the replay and release the buffer.
+  if (replayBuffer.size() + payload.size() > replayBufferSize)
+  {
+    isReplayable = false;
+    replayBuffer.clear();
+    replayFrames.clear();
+    bufferedBytes = 0;
+    return;
+  }
+
+  replayBuffer.append(payload);
+  replayFrames.push_back(payload.size());
+  bufferedBytes = replayBuffer.size();
+  if (bufferedBytes > peakBufferedBytes)
+  {
+    peakBufferedBytes = bufferedBytes.load();
+  }
+}
+
+/**
+ * A new connection knows nothing about the utterance in flight, so resend it from the start.
+ */
+void AsrClient::replayUtterance()
+{
+  // Either there's nothing in flight, the server has already answered or the listening session is over.
+  if (!isUtteranceActive || isUtteranceAnswered() || SteadyClock::now() - utteranceStartTime > listeningTimeout)
+  {
+    return;
+  }
+
+  if (!isReplayable)
+  {
+    dropUtterance();
+    return;
+  }
+
+  size_t offset = 0;
+  for (size_t frameSize : replayFrames)
+  {
+    transport->sendBinary(replayBuffer.substr(offset, frameSize));
+    offset += frameSize;
+    sentFrames++;
+    sentBytes += frameSize;
+  }
+  if (!replayFrames.empty())
+  {
+    latencyTracker->mark(FIRST_SENT);
+  }
+  if (isUtteranceEnded)
+  {
+    sendEof();
+  }
+  verbose(VV_INFO, stdout, "Replayed %zu frames (%zu bytes) of the current utterance", replayFrames.size(), replayBuffer.size());
+}
+
+/**
+ * Transcripts received from now on are published as a part of the new utterance, except for the answer to the previous EOF.
+ */
+void AsrClient::startUtterance()
+{
+  // The previous utterance has timed out without an EOF: let the server finalize it rather than mix it into this one.
+  if (isUtteranceActive && !isUtteranceEnded && wasConnected)
+  {
+    sendEof();
+  }
+  utteranceResultBase.store(isEofSent && !isUtteranceAnswered() ? eofFinalResults + 1 : finalResults.load(), memory_order_relaxed);
+  utteranceDirection.store(startDirection.load(memory_order_relaxed), memory_order_relaxed);
+  utteranceId.fetch_add(1, memory_order_release);
+}
+
+/**
+ * Final results received before the EOF belong to the utterance's earlier phrases, only the next one finishes it.
+ */
+void AsrClient::sendEof()
+{
+  eofFinalResults = max(finalResults.load(), utteranceResultBase.load());
+  isEofSent = transport->sendText(ASR_EOF_MESSAGE);
+}
+
+bool AsrClient::isUtteranceAnswered()
+{
+  return isEofSent && finalResults.load() > eofFinalResults;
+}
+
+/**
+ * Server has finalized the utterance (Vosk closes the connection right after that), so there's nothing left to replay.
+ */
+void AsrClient::finishUtterance()
+{
+  isUtteranceActive = false;
+  replayBuffer.clear();
+  replayFrames.clear();
+  bufferedBytes = 0;
+}
+
+void AsrClient::dropUtterance()
+{
+  if (!isUtteranceDropped)
+  {
+    isUtteranceDropped = true;
+    droppedUtterances++;
+    verbose(VV_INFO, stdout, "Current utterance is lost: it doesn't fit into the replay buffer");
+  }
+}
+
+/**
+ * Exponential backoff with "equal jitter": wait somewhere between a half and the whole of the current delay,
+ * so a fleet of devices doesn't reconnect in lockstep after the server restart.
+ */
+void AsrClient::scheduleReconnect(TimePoint now)
+{
+  chrono::milliseconds delay = reconnectMinDelay * (1LL << min(reconnectAttempts, ASR_MAX_BACKOFF_SHIFT));
+  delay = min(delay, reconnectMaxDelay);
+  uniform_int_distribution<long long> jitter(delay.count() / 2, delay.count());
+  nextReconnectTime = now + chrono::milliseconds(jitter(random));
+  reconnectAttempts++;
+}
+
+void AsrClient::reconnectIfDue()
+{
+  TimePoint now = SteadyClock::now();
+  if (!isStarted || now < nextReconnectTime)
+  {
+    return;
+  }
+
+  verbose(VV_INFO, stdout, "Reconnecting to ASR server, attempt %d", reconnectAttempts + 1);
+  transport->stop();
+  transport->start();
+  scheduleReconnect(now);
+}
+
+void AsrClient::flushFrame()
+{
+  sendFrame(frame);
+  frame.clear();
+  frameAudioBytes = 0;
+}
+
+bool AsrClient::isConnected() {
+  return _isConnected;
+}
+
+bool AsrClient::isTranscribeReceived() {
+  return _isTranscribeReceived;
+}
+
+/**
+ * Final transcribe event: true once per received transcribe. While there's none, it costs the audio loop a single relaxed load.
+ */
+bool AsrClient::takeTranscribe() {
+  return isTranscribePending.load(memory_order_relaxed) && isTranscribePending.exchange(false, memory_order_acquire);
+}
+
+/**
+ * Resetting the state also discards a pending event, e.g. a late transcribe of the previous session.
+ */
+void AsrClient::isTranscribed(bool state) {
+  _isTranscribeReceived = state;
+  if (!state) {
+    isTranscribePending = false;
+  }
+}
+
+TimePoint AsrClient::transcribeReceivedTime() {
+  return TimePoint(SteadyClock::duration(transcribeTime.load(memory_order_relaxed)));
+}
+
+AudioQueueStats AsrClient::queueStats() {
+  return queue.stats();
+}
+
+FrameStats AsrClient::frameStats() {
+  return {sentFrames, sentBytes};
+}
+
+ReconnectStats AsrClient::reconnectStats() {
+  return {reconnects, bufferedBytes, peakBufferedBytes, droppedUtterances};
+}
+
+EncoderStats AsrClient::encoderStats() {
+  return {encoder != nullptr ? encoder->name() : "pcm", encodedBlocks, encoderInputBytes, encoderOutputBytes, encodeMicros};
+}
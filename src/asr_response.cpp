@@ -0,0 +1,472 @@
+#include "asr_response.hpp"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+static int hexDigit(char c)
+{
+  if (c >= '0' && c <= '9')
+  {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f')
+  {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F')
+  {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+bool AsrResponseParser::parse(const string &message, AsrResponse &response)
+{
+  position = message.data();
+  end = position + message.size();
+  depth = 0;
+
+  response.text.clear();
+  response.partial.clear();
+  response.hasText = false;
+  response.hasPartial = false;
+  response.hasResult = false;
+  response.words.clear();
+  response.confidence = -1;
+
+  skipSpaces();
+  if (!consume('{'))
+  {
+    return false;
+  }
+
+  skipSpaces();
+  if (!consume('}'))
+  {
+    do
+    {
+      const char *key;
+      size_t length;
+      bool isRead;
+
+      skipSpaces();
+      if (!readKey(key, length))
+      {
+        return false;
+      }
+      skipSpaces();
+      if (!consume(':'))
+      {
+        return false;
+      }
+      skipSpaces();
+
+      // Fields of an unexpected type are skipped as if they were unknown.
+      if (isKey(key, length, "text") && peek('"'))
+      {
+        isRead = response.hasText = readString(&response.text);
+      }
+      else if (isKey(key, length, "partial") && peek('"'))
+      {
+        isRead = response.hasPartial = readString(&response.partial);
+      }
+      else if (isKey(key, length, "result") && peek('['))
+      {
+        isRead = response.hasResult = readResult(response);
+      }
+      else
+      {
+        isRead = skipValue();
+      }
+
+      if (!isRead)
+      {
+        return false;
+      }
+      skipSpaces();
+    } while (consume(','));
+
+    if (!consume('}'))
+    {
+      return false;
+    }
+  }
+
+  skipSpaces();
+  return position == end;
+}
+
+void AsrResponseParser::skipSpaces()
+{
+  while (position < end && (*position == ' ' || *position == '\n' || *position == '\r' || *position == '\t'))
+  {
+    position++;
+  }
+}
+
+bool AsrResponseParser::consume(char c)
+{
+  if (position < end && *position == c)
+  {
+    position++;
+    return true;
+  }
+  return false;
+}
+
+bool AsrResponseParser::peek(char c)
+{
+  return position < end && *position == c;
+}
+
+/**
+ * Keys are compared as they are on the wire: the ones we need have nothing to unescape.
+ */
+bool AsrResponseParser::readKey(const char *&key, size_t &length)
+{
+  if (!consume('"'))
+  {
+    return false;
+  }
+
+  key = position;
+  while (position < end && *position != '"')
+  {
+    if (*position == '\\' && ++position == end)
+    {
+      return false;
+    }
+    position++;
+  }
+  if (position >= end)
+  {
+    return false;
+  }
+
+  length = position - key;
+  position++;
+  return true;
+}
+
+bool AsrResponseParser::isKey(const char *key, size_t length, const char *name)
+{
+  return length == strlen(name) && !memcmp(key, name, length);
+}
+
+/**
+ * Unescaped string is appended to the value, or just skipped when it's null. Unescaped runs are copied at once.
+ */
+bool AsrResponseParser::readString(string *value)
+{
+  if (!consume('"'))
+  {
+    return false;
+  }
+
+  while (position < end)
+  {
+    const char *run = position;
+    while (position < end && *position != '"' && *position != '\\')
+    {
+      position++;
+    }
+    if (value != nullptr)
+    {
+      value->append(run, position - run);
+    }
+    if (position >= end)
+    {
+      return false;
+    }
+    if (*position++ == '"')
+    {
+      return true;
+    }
+
+    if (position >= end)
+    {
+      return false;
+    }
+    char escaped = *position++;
+    char unescaped;
+    switch (escaped)
+    {
+    case '"':
+    case '\\':
+    case '/':
+      unescaped = escaped;
+      break;
+    case 'b':
+      unescaped = '\b';
+      break;
+    case 'f':
+      unescaped = '\f';
+      break;
+    case 'n':
+      unescaped = '\n';
+      break;
+    case 'r':
+      unescaped = '\r';
+      break;
+    case 't':
+      unescaped = '\t';
+      break;
+    case 'u':
+    {
+      uint32_t codePoint = 0;
+      for (int i = 0; i < 4; i++)
+      {
+        int digit = position < end ? hexDigit(*position++) : -1;
+        if (digit < 0)
+        {
+          return false;
+        }
+        codePoint = codePoint << 4 | digit;
+      }
+
+      // Characters outside of the basic plane come as a surrogate pair.
+      if (codePoint >= 0xD800 && codePoint <= 0xDBFF && end - position >= 6 && position[0] == '\\' && position[1] == 'u')
+      {
+        uint32_t low = 0;
+        for (int i = 2; i < 6 && hexDigit(position[i]) >= 0; i++)
+        {
+          low = low << 4 | hexDigit(position[i]);
+        }
+        if (low >= 0xDC00 && low <= 0xDFFF)
+        {
+          codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+          position += 6;
+        }
+      }
+      if (value != nullptr)
+      {
+        appendUtf8(*value, codePoint);
+      }
+      continue;
+    }
+    default:
+      return false;
+    }
+
+    if (value != nullptr)
+    {
+      value->push_back(unescaped);
+    }
+  }
+  return false;
+}
+
+void AsrResponseParser::appendUtf8(string &value, uint32_t codePoint)
+{
+  if (codePoint < 0x80)
+  {
+    value.push_back((char)codePoint);
+  }
+  else if (codePoint < 0x800)
+  {
+    value.push_back((char)(0xC0 | codePoint >> 6));
+    value.push_back((char)(0x80 | (codePoint & 0x3F)));
+  }
+  else if (codePoint < 0x10000)
+  {
+    value.push_back((char)(0xE0 | codePoint >> 12));
+    value.push_back((char)(0x80 | (codePoint >> 6 & 0x3F)));
+    value.push_back((char)(0x80 | (codePoint & 0x3F)));
+  }
+  else
+  {
+    value.push_back((char)(0xF0 | codePoint >> 18));
+    value.push_back((char)(0x80 | (codePoint >> 12 & 0x3F)));
+    value.push_back((char)(0x80 | (codePoint >> 6 & 0x3F)));
+    value.push_back((char)(0x80 | (codePoint & 0x3F)));
+  }
+}
+
+/**
+ * Message is a std::string, so strtod always stops at its terminating zero.
+ */
+bool AsrResponseParser::readNumber(double &value)
+{
+  char *next;
+  value = strtod(position, &next);
+  if (next == position || next > end)
+  {
+    return false;
+  }
+  position = next;
+  return true;
+}
+
+/**
+ * Array of recognized words with their timings and confidence.
+ */
+bool AsrResponseParser::readResult(AsrResponse &response)
+{
+  double confidenceSum = 0;
+  int confidenceCount = 0;
+
+  consume('[');
+  skipSpaces();
+  if (!consume(']'))
+  {
+    do
+    {
+      response.words.push_back({"", -1, -1, -1});
+      AsrWord &word = response.words.back();
+
+      skipSpaces();
+      if (!(peek('{') ? readWord(word) : skipValue()))
+      {
+        return false;
+      }
+      if (word.confidence >= 0)
+      {
+        confidenceSum += word.confidence;
+        confidenceCount++;
+      }
+      skipSpaces();
+    } while (consume(','));
+
+    if (!consume(']'))
+    {
+      return false;
+    }
+  }
+
+  if (confidenceCount > 0)
+  {
+    response.confidence = confidenceSum / confidenceCount;
+  }
+  return true;
+}
+
+bool AsrResponseParser::readWord(AsrWord &word)
+{
+  consume('{');
+  skipSpaces();
+  if (consume('}'))
+  {
+    return true;
+  }
+
+  do
+  {
+    const char *key;
+    size_t length;
+
+    skipSpaces();
+    if (!readKey(key, length))
+    {
+      return false;
+    }
+    skipSpaces();
+    if (!consume(':'))
+    {
+      return false;
+    }
+    skipSpaces();
+
+    bool isNumber = position < end && (*position == '-' || (*position >= '0' && *position <= '9'));
+    bool isRead;
+    if (isKey(key, length, "word") && peek('"'))
+    {
+      isRead = readString(&word.word);
+    }
+    else if (isKey(key, length, "conf") && isNumber)
+    {
+      isRead = readNumber(word.confidence);
+    }
+    else if (isKey(key, length, "start") && isNumber)
+    {
+      isRead = readNumber(word.start);
+    }
+    else if (isKey(key, length, "end") && isNumber)
+    {
+      isRead = readNumber(word.end);
+    }
+    else
+    {
+      isRead = skipValue();
+    }
+
+    if (!isRead)
+    {
+      return false;
+    }
+    skipSpaces();
+  } while (consume(','));
+
+  return consume('}');
+}
+
+/**
+ * Skip any JSON value. Nesting is limited, so a hostile message can't exhaust the stack.
+ */
+bool AsrResponseParser::skipValue()
+{
+  if (position >= end)
+  {
+    return false;
+  }
+
+  char opening = *position;
+  if (opening == '"')
+  {
+    return readString(nullptr);
+  }
+
+  if (opening == '{' || opening == '[')
+  {
+    char closing = opening == '{' ? '}' : ']';
+    if (++depth > ASR_MAX_DEPTH)
+    {
+      return false;
+    }
+
+    position++;
+    skipSpaces();
+    if (!consume(closing))
+    {
+      do
+      {
+        skipSpaces();
+        if (opening == '{')
+        {
+          const char *key;
+          size_t length;
+          if (!readKey(key, length))
+          {
+            return false;
+          }
+          skipSpaces();
+          if (!consume(':'))
+          {
+            return false;
+          }
+          skipSpaces();
+        }
+        if (!skipValue())
+        {
+          return false;
+        }
+        skipSpaces();
+      } while (consume(','));
+
+      if (!consume(closing))
+      {
+        return false;
+      }
+    }
+    depth--;
+    return true;
+  }
+
+  // Numbers, true, false and null.
+  const char *start = position;
+  while (position < end && (isalnum((unsigned char)*position) || *position == '-' || *position == '+' || *position == '.'))
+  {
+    position++;
+  }
+  return position > start;
+}
@@ -0,0 +1,219 @@
+#include "audio_encoder.hpp"
+
+extern "C"
+{
+#include "verbose.h"
+}
+
+static const int ADPCM_INDEX_TABLE[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8};
+
+static const int ADPCM_STEP_TABLE[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+    12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+AdpcmEncoder::AdpcmEncoder(int channels) : states(channels, {0, 0})
+{
+}
+
+string AdpcmEncoder::name()
+{
+  return "adpcm";
+}
+
+uint8_t AdpcmEncoder::encodeSample(ChannelState &state, int16_t sample)
+{
+  int step = ADPCM_STEP_TABLE[state.index];
+  int diff = sample - state.predictor;
+  int delta = step >> 3;
+  uint8_t nibble = 0;
+
+  if (diff < 0)
+  {
+    nibble = 8;
+    diff = -diff;
+  }
+  if (diff >= step)
+  {
+    nibble |= 4;
+    diff -= step;
+    delta += step;
+  }
+  step >>= 1;
+  if (diff >= step)
+  {
+    nibble |= 2;
+    diff -= step;
+    delta += step;
+  }
+  step >>= 1;
+  if (diff >= step)
+  {
+    nibble |= 1;
+    delta += step;
+  }
+
+  state.predictor += (nibble & 8) ? -delta : delta;
+  state.predictor = state.predictor > INT16_MAX ? INT16_MAX : state.predictor < INT16_MIN ? INT16_MIN : state.predictor;
+  state.index += ADPCM_INDEX_TABLE[nibble];
+  state.index = state.index > 88 ? 88 : state.index < 0 ? 0 : state.index;
+  return nibble;
+}
+
+void AdpcmEncoder::encode(const string &pcm, string &encoded)
+{
+  const int16_t *samples = (const int16_t *)pcm.data();
+  size_t count = pcm.size() / sizeof(int16_t);
+  size_t channels = states.size();
+
+  size_t samplesPerChannel = count / channels;
+
+  encoded.clear();
+  encoded.push_back((char)(samplesPerChannel & 0xFF));
+  encoded.push_back((char)((samplesPerChannel >> 8) & 0xFF));
+  for (ChannelState &state : states)
+  {
+    encoded.push_back((char)(state.predictor & 0xFF));
+    encoded.push_back((char)((state.predictor >> 8) & 0xFF));
+    encoded.push_back((char)state.index);
+    encoded.push_back(0);
+  }
+
+  uint8_t packed = 0;
+  for (size_t i = 0; i < count; i++)
+  {
+    uint8_t nibble = encodeSample(states[i % channels], samples[i]);
+    if (i % 2 == 0)
+    {
+      packed = nibble;
+    }
+    else
+    {
+      encoded.push_back((char)(packed | (nibble << 4)));
+    }
+  }
+  if (count % 2)
+  {
+    encoded.push_back((char)packed);
+  }
+}
+
+void AdpcmEncoder::reset()
+{
+  for (ChannelState &state : states)
+  {
+    state = {0, 0};
+  }
+}
+
+#ifdef WITH_OPUS
+OpusAudioEncoder::OpusAudioEncoder(int rate, int channels, int bitrate)
+{
+  int error = OPUS_OK;
+  this->channels = channels;
+  frameSamples = rate / 1000 * OPUS_FRAME_MS * channels;
+  pending.reserve(frameSamples * 2);
+  encoder = opus_encoder_create(rate, channels, OPUS_APPLICATION_VOIP, &error);
+  if (error != OPUS_OK)
+  {
+    verbose(V_NORMAL, stderr, "Unable to create Opus encoder for %d Hz: %s", rate, opus_strerror(error));
+    encoder = nullptr;
+    return;
+  }
+  opus_encoder_ctl(encoder, OPUS_SET_BITRATE(bitrate));
+  opus_encoder_ctl(encoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
+}
+
+OpusAudioEncoder::~OpusAudioEncoder()
+{
+  if (encoder != nullptr)
+  {
+    opus_encoder_destroy(encoder);
+  }
+}
+
+bool OpusAudioEncoder::isCreated()
+{
+  return encoder != nullptr;
+}
+
+string OpusAudioEncoder::name()
+{
+  return "opus";
+}
+
+void OpusAudioEncoder::encode(const string &pcm, string &encoded)
+{
+  const int16_t *samples = (const int16_t *)pcm.data();
+  pending.insert(pending.end(), samples, samples + pcm.size() / sizeof(int16_t));
+
+  encoded.clear();
+  size_t offset = 0;
+  while (pending.size() - offset >= frameSamples)
+  {
+    encodePacket(pending.data() + offset, encoded);
+    offset += frameSamples;
+  }
+  pending.erase(pending.begin(), pending.begin() + offset);
+}
+
+void OpusAudioEncoder::flush(string &encoded)
+{
+  encoded.clear();
+  if (!pending.empty())
+  {
+    pending.resize(frameSamples, 0);
+    encodePacket(pending.data(), encoded);
+    pending.clear();
+  }
+}
+
+void OpusAudioEncoder::reset()
+{
+  pending.clear();
+  opus_encoder_ctl(encoder, OPUS_RESET_STATE);
+}
+
+void OpusAudioEncoder::encodePacket(const int16_t *samples, string &encoded)
+{
+  int length = opus_encode(encoder, samples, frameSamples / channels, packet, OPUS_MAX_PACKET);
+  if (length < 0)
+  {
+    verbose(V_NORMAL, stderr, "Opus encoding failed: %s", opus_strerror(length));
+    return;
+  }
+  encoded.push_back((char)(length & 0xFF));
+  encoded.push_back((char)((length >> 8) & 0xFF));
+  encoded.append((const char *)packet, length);
+}
+#endif
+
+unique_ptr<AudioEncoder> createAudioEncoder(const string &codec, int rate, int channels, int bitrate)
+{
+  if (codec == "adpcm")
+  {
+    return unique_ptr<AudioEncoder>(new AdpcmEncoder(channels));
+  }
+#ifdef WITH_OPUS
+  else if (codec == "opus")
+  {
+    // Opus only takes 8, 12, 16, 24 and 48 kHz: e.g. a 44.1 kHz file is streamed as is.
+    unique_ptr<OpusAudioEncoder> encoder(new OpusAudioEncoder(rate, channels, bitrate));
+    if (encoder->isCreated())
+    {
+      return move(encoder);
+    }
+    verbose(V_NORMAL, stderr, "Falling back to raw PCM");
+  }
+#endif
+  else if (codec != "pcm")
+  {
+    verbose(V_NORMAL, stderr, "Unsupported codec '%s', falling back to raw PCM", codec.c_str());
+  }
+  return nullptr;
+}
@@ -0,0 +1,297 @@
+#include "audio_queue.hpp"
+
+#include <thread>
+
+OverflowPolicy textToOverflowPolicy(const string &policy)
+{
+  if (policy == "dropNewest")
+  {
+    return OverflowPolicy::DropNewest;
+  }
+  else if (policy == "block")
+  {
+    return OverflowPolicy::Block;
+  }
+  return OverflowPolicy::DropOldest;
+}
+
+AudioQueue::AudioQueue(size_t depth, OverflowPolicy policy, size_t blockBytes)
+{
+  // Round up to a power of 2 to replace modulo with a mask.
+  capacity = 2;
+  while (capacity < depth)
+  {
+    capacity <<= 1;
+  }
+  mask = capacity - 1;
+  this->policy = policy;
+
+  slots.reset(new Slot[capacity]);
+  for (size_t i = 0; i < capacity; i++)
+  {
+    slots[i].sequence.store(i, memory_order_relaxed);
+    slots[i].chunk.data.reserve(blockBytes);
+  }
+  dropped.data.reserve(blockBytes);
+
+  enqueuePos = 0;
+  dequeuePos = 0;
+  markerHead = 0;
+  markerTail = 0;
+  closed = false;
+  highWaterMark = 0;
+  pushedCount = 0;
+  copiedCount = 0;
+  droppedCount = 0;
+  isConsumerWaiting = false;
+  isProducerWaiting = false;
+}
+
+/**
+ * Either swap the moved chunk into the slot or copy the view into the slot's preallocated buffer.
+ */
+bool AudioQueue::tryPush(AudioChunk *chunk, const AudioView &view)
+{
+  size_t pos = enqueuePos.load(memory_order_relaxed);
+  Slot &slot = slots[pos & mask];
+
+  // Slot is either still occupied or being read by a consumer.
+  if (slot.sequence.load(memory_order_acquire) != pos)
+  {
+    return false;
+  }
+
+  if (chunk != nullptr)
+  {
+    slot.chunk.data.swap(chunk->data);
+    slot.chunk.captureTime = chunk->captureTime;
+    slot.chunk.kind = chunk->kind;
+  }
+  else
+  {
+    slot.chunk.data.assign(view.data, view.size);
+    slot.chunk.captureTime = SteadyClock::now();
+    slot.chunk.kind = ChunkKind::Audio;
+    copiedCount.fetch_add(1, memory_order_relaxed);
+  }
+  slot.sequence.store(pos + 1, memory_order_release);
+  enqueuePos.store(pos + 1, memory_order_seq_cst);
+  return true;
+}
+
+/**
+ * Called from the audio thread only. On success the chunk gets back a spare buffer from the ring.
+ */
+bool AudioQueue::push(AudioChunk &&chunk)
+{
+  return push(&chunk, {nullptr, 0});
+}
+
+/**
+ * Called from the audio thread only.
+ */
+bool AudioQueue::push(const AudioView &view)
+{
+  return push(nullptr, view);
+}
+
+/**
+ * Called from the audio thread only. The marker goes out right after the blocks pushed before it, whatever the overflow policy.
+ */
+bool AudioQueue::pushMarker(ChunkKind kind)
+{
+  size_t tail = markerTail.load(memory_order_relaxed);
+
+  // Only a sender which is stuck for several utterances in a row gets here: wait for it rather than lose the marker.
+  while (tail - markerHead.load(memory_order_acquire) >= QUEUE_MARKER_DEPTH)
+  {
+    if (closed)
+    {
+      return false;
+    }
+    unique_lock<mutex> lock(waitLock);
+    isProducerWaiting = true;
+    if (tail - markerHead.load(memory_order_acquire) >= QUEUE_MARKER_DEPTH && !closed)
+    {
+      notFull.wait_for(lock, chrono::milliseconds(QUEUE_WAIT_TIMEOUT));
+    }
+    isProducerWaiting = false;
+  }
+
+  Marker &marker = markers[tail % QUEUE_MARKER_DEPTH];
+  marker.kind = kind;
+  marker.position = enqueuePos.load(memory_order_relaxed);
+  marker.captureTime = SteadyClock::now();
+  markerTail.store(tail + 1, memory_order_release);
+
+  wakeConsumer();
+  return true;
+}
+
+bool AudioQueue::push(AudioChunk *chunk, const AudioView &view)
+{
+  while (!tryPush(chunk, view))
+  {
+    if (closed)
+    {
+      return false;
+    }
+
+    if (policy == OverflowPolicy::DropNewest)
+    {
+      droppedCount.fetch_add(1, memory_order_relaxed);
+      return false;
+    }
+    else if (policy == OverflowPolicy::DropOldest)
+    {
+      if (tryPop(dropped, false))
+      {
+        droppedCount.fetch_add(1, memory_order_relaxed);
+      }
+      else
+      {
+        // The sender thread is in the middle of swapping out the oldest slot.
+        this_thread::yield();
+      }
+    }
+    else
+    {
+      unique_lock<mutex> lock(waitLock);
+      isProducerWaiting = true;
+      if (size() >= capacity && !closed)
+      {
+        notFull.wait_for(lock, chrono::milliseconds(QUEUE_WAIT_TIMEOUT));
+      }
+      isProducerWaiting = false;
+    }
+  }
+
+  pushedCount.fetch_add(1, memory_order_relaxed);
+  size_t used = size();
+  if (used > highWaterMark.load(memory_order_relaxed))
+  {
+    highWaterMark.store(used, memory_order_relaxed);
+  }
+
+  wakeConsumer();
+  return true;
+}
+
+bool AudioQueue::tryPop(AudioChunk &chunk)
+{
+  return tryPop(chunk, true);
+}
+
+/**
+ * The producer discards the oldest blocks with takeMarkers unset, so markers are only ever taken by the sender thread.
+ */
+bool AudioQueue::tryPop(AudioChunk &chunk, bool takeMarkers)
+{
+  size_t pos = dequeuePos.load(memory_order_relaxed);
+
+  for (;;)
+  {
+    Slot &slot = slots[pos & mask];
+    size_t sequence = slot.sequence.load(memory_order_acquire);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+
+    // The marker is due once every block before it is either popped or dropped. It's checked after the slot is,
+    // so a marker pushed before the block at pos is already visible; the block can't be taken past a due marker either:
+    // the exchange below fails if the producer has moved the position on.
+    size_t head = markerHead.load(memory_order_relaxed);
+    if (takeMarkers && head != markerTail.load(memory_order_acquire) && (intptr_t)(markers[head % QUEUE_MARKER_DEPTH].position - pos) <= 0)
+    {
+      Marker &marker = markers[head % QUEUE_MARKER_DEPTH];
+      chunk.data.clear();
+      chunk.captureTime = marker.captureTime;
+      chunk.kind = marker.kind;
+      markerHead.store(head + 1, memory_order_release);
+      wakeProducer();
+      return true;
+    }
+
+    if (diff == 0)
+    {
+      if (dequeuePos.compare_exchange_weak(pos, pos + 1, memory_order_seq_cst, memory_order_relaxed))
+      {
+        chunk.data.swap(slot.chunk.data);
+        chunk.captureTime = slot.chunk.captureTime;
+        chunk.kind = slot.chunk.kind;
+        slot.sequence.store(pos + capacity, memory_order_release);
+        wakeProducer();
+        return true;
+      }
+    }
+    else if (diff < 0)
+    {
+      return false;
+    }
+    else
+    {
+      pos = dequeuePos.load(memory_order_relaxed);
+    }
+  }
+}
+
+bool AudioQueue::waitPop(AudioChunk &chunk, chrono::milliseconds timeout)
+{
+  if (tryPop(chunk))
+  {
+    return true;
+  }
+
+  {
+    unique_lock<mutex> lock(waitLock);
+    isConsumerWaiting = true;
+    if (size() == 0 && !hasMarker() && !closed)
+    {
+      notEmpty.wait_for(lock, timeout);
+    }
+    isConsumerWaiting = false;
+  }
+
+  return tryPop(chunk);
+}
+
+void AudioQueue::wakeConsumer()
+{
+  if (isConsumerWaiting)
+  {
+    lock_guard<mutex> lock(waitLock);
+    notEmpty.notify_one();
+  }
+}
+
+void AudioQueue::wakeProducer()
+{
+  if (isProducerWaiting)
+  {
+    lock_guard<mutex> lock(waitLock);
+    notFull.notify_one();
+  }
+}
+
+void AudioQueue::close()
+{
+  closed = true;
+  lock_guard<mutex> lock(waitLock);
+  notEmpty.notify_all();
+  notFull.notify_all();
+}
+
+bool AudioQueue::hasMarker()
+{
+  return markerHead.load(memory_order_acquire) != markerTail.load(memory_order_acquire);
+}
+
+size_t AudioQueue::size()
+{
+  size_t head = dequeuePos.load(memory_order_seq_cst);
+  size_t tail = enqueuePos.load(memory_order_seq_cst);
+  return tail > head ? tail - head : 0;
+}
+
+AudioQueueStats AudioQueue::stats()
+{
+  return {capacity, highWaterMark.load(), pushedCount.load(), copiedCount.load(), droppedCount.load()};
+}
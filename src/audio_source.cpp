@@ -0,0 +1,26 @@
+#include "audio_source.hpp"
+#include "file_audio_source.hpp"
+
+#ifdef WITH_RESPEAKER
+#include "respeaker_core.hpp"
+#endif
+
+extern "C"
+{
+#include "verbose.h"
+}
+
+AudioSource *createAudioSource(Config *config)
+{
+  if (config->audioSourceType() == "file")
+  {
+    return new FileAudioSource(config);
+  }
+
+#ifdef WITH_RESPEAKER
+  return new RespeakerCore(config);
+#else
+  verbose(V_NORMAL, stderr, "Built without librespeaker: only \"file\" audio source is available");
+  return nullptr;
+#endif
+}
@@ -15,18 +15,19 @@
 
 #include "cAPA102.h"
 
-static cAPA102_LEDs cAPA012_BUF = {0, -1, NULL, 31};
+static cAPA102_LEDs cAPA012_BUF = {0, -1, NULL, 31, cAPA102_SPIDEV, NULL, 0, 0, NULL, 0, 0, 0, 0, 0, {0, 0}};
+static char cAPA102_OUTPUT_PATH[256] = "";
 
 /**
- * @brief: Try to open the SPI device by given times
+ * @brief: Try to open the SPI device by given times, the gap between attempts is doubled each time
  *
  * @param[in] retry_times
- * @param[in] retry_gap_sec:
+ * @param[in] retry_gap_ms: the first gap
  *
  * @returns: int\ The file descriptor of SPI device or
  *            -1\ Error
  */
-static int cAPA102_Try_Open_SPI_Dev(uint8_t retry_times, uint8_t retry_gap_sec, uint8_t spi_bus, uint8_t spi_dev);
+static int cAPA102_Try_Open_SPI_Dev(uint8_t retry_times, int retry_gap_ms, uint8_t spi_bus, uint8_t spi_dev);
 
 /**
  * @brief Open the SPI device file
@@ -36,16 +37,82 @@ static int cAPA102_Try_Open_SPI_Dev(uint8_t retry_times, uint8_t retry_gap_sec,
  */
 static int cAPA102_Open_SPI_Dev(uint8_t spi_bus, uint8_t spi_dev);
 
+/**
+ * @brief: Write global brightness into every pixel of the frame
+ */
+static void cAPA102_Set_Frame_Brightness(void);
+
+/**
+ * @brief: Open the output file or named pipe of the file backend
+ *
+ * @returns: int\ The file descriptor or
+ *            -1\ Error
+ */
+static int cAPA102_Open_File(const char *path);
+
+/**
+ * @brief: Write a line into the named pipe, reopening it when a reader shows up
+ */
+static int cAPA102_Write_Fifo(const char *line, size_t len);
+
+/**
+ * @brief: Send a frame to the selected backend
+ *
+ * @returns: 0\ On Success
+ *          -1\ Error, or the frame was dropped
+ */
+static int cAPA102_Write_Frame(const uint8_t *tx);
+
+void cAPA102_Set_Backend(cAPA102_BACKEND backend, const char *path)
+{
+    cAPA012_BUF.backend = backend;
+    snprintf(cAPA102_OUTPUT_PATH, sizeof(cAPA102_OUTPUT_PATH), "%s", path ? path : "");
+}
+
 int cAPA102_Init(uint32_t led_num, uint8_t spi_bus, uint8_t spi_dev, uint8_t brightness)
 {
+    uint32_t i;
+
     cAPA012_BUF.number = led_num;
     if (brightness > 31)
         cAPA012_BUF.brightness = 0xFF;
     else
         cAPA012_BUF.brightness = 0xE0 | (0x1F & brightness);
-    cAPA012_BUF.pixels = (uint8_t *)malloc(cAPA012_BUF.number * 4);
-    cAPA012_BUF.fd_spi = cAPA102_Try_Open_SPI_Dev(RETRY_TIMES, RETRY_GAP_SEC, spi_bus, spi_dev);
-    if (-1 == cAPA012_BUF.fd_spi)
+
+    /* Start frame, pixels and end frame are laid out once, refresh only sends them */
+    cAPA012_BUF.tx_len = START_FRAME_LEN + 4 * cAPA012_BUF.number + (cAPA012_BUF.number + 15) / 16 + 1;
+    cAPA012_BUF.tx = (uint8_t *)calloc(cAPA012_BUF.tx_len, 1);
+    if (!cAPA012_BUF.tx)
+        return -1;
+    for (i = START_FRAME_LEN + 4 * cAPA012_BUF.number; i < cAPA012_BUF.tx_len; i++)
+        cAPA012_BUF.tx[i] = 0x01;
+    cAPA012_BUF.pixels = cAPA012_BUF.tx + START_FRAME_LEN;
+    cAPA102_Set_Frame_Brightness();
+    cAPA012_BUF.dirty = 1;
+    cAPA012_BUF.transfers = 0;
+    cAPA012_BUF.bytes = 0;
+    cAPA012_BUF.skipped = 0;
+    clock_gettime(CLOCK_MONOTONIC, &cAPA012_BUF.since);
+
+    switch (cAPA012_BUF.backend)
+    {
+    case cAPA102_FILE:
+        /* "<seconds> RRGGBB RRGGBB ...\n", formatted in place */
+        cAPA012_BUF.line = (char *)malloc(32 + 7 * cAPA012_BUF.number);
+        if (!cAPA012_BUF.line)
+            return -1;
+        cAPA012_BUF.fd_spi = cAPA102_Open_File(cAPA102_OUTPUT_PATH);
+        /* Named pipe without a reader yet is fine: frames are dropped until one connects */
+        if (-1 == cAPA012_BUF.fd_spi && cAPA012_BUF.is_fifo && ENXIO == errno)
+            return 0;
+        break;
+    case cAPA102_NULL:
+        cAPA012_BUF.fd_spi = -1;
+        break;
+    default:
+        cAPA012_BUF.fd_spi = cAPA102_Try_Open_SPI_Dev(RETRY_TIMES, RETRY_GAP_MS, spi_bus, spi_dev);
+    }
+    if (-1 == cAPA012_BUF.fd_spi && cAPA102_NULL != cAPA012_BUF.backend)
         return -1;
     cAPA102_Clear_All();
     return 0;
@@ -57,9 +124,18 @@ void cAPA102_Change_Brightness(uint8_t brightness)
         cAPA012_BUF.brightness = 0xFF;
     else
         cAPA012_BUF.brightness = 0xE0 | (0x1F & brightness);
+    cAPA102_Set_Frame_Brightness();
+    cAPA012_BUF.dirty = 1;
     cAPA102_Refresh();
 }
 
+static void cAPA102_Set_Frame_Brightness(void)
+{
+    uint32_t i;
+    for (i = 0; i < cAPA012_BUF.number; i++)
+        cAPA012_BUF.pixels[i * 4] = cAPA012_BUF.brightness;
+}
+
 int cAPA102_Get_Brightness(void)
 {
     return cAPA012_BUF.brightness & 0x1F;
@@ -70,9 +146,13 @@ void cAPA102_Set_Pixel_RGB(uint32_t index, uint8_t red, uint8_t green, uint8_t b
     if (index < cAPA012_BUF.number)
     {
         uint8_t *ptr = &cAPA012_BUF.pixels[index * 4];
-        ptr[R_OFF_SET] = red;
-        ptr[G_OFF_SET] = green;
-        ptr[B_OFF_SET] = blue;
+        if (ptr[R_OFF_SET] != red || ptr[G_OFF_SET] != green || ptr[B_OFF_SET] != blue)
+        {
+            ptr[R_OFF_SET] = red;
+            ptr[G_OFF_SET] = green;
+            ptr[B_OFF_SET] = blue;
+            cAPA012_BUF.dirty = 1;
+        }
     }
 }
 
@@ -107,54 +187,126 @@ uint32_t cAPA102_Get_Pixel_4byte(uint32_t index)
     return colour;
 }
 
+void cAPA102_Fill_4byte(uint32_t colour)
+{
+    uint8_t *ptr;
+    uint32_t i;
+    uint8_t r = colour >> 16, g = colour >> 8, b = colour;
+    for (ptr = cAPA012_BUF.pixels, i = 0; i < cAPA012_BUF.number; i++, ptr += 4)
+    {
+        if (ptr[R_OFF_SET] != r || ptr[G_OFF_SET] != g || ptr[B_OFF_SET] != b)
+        {
+            ptr[R_OFF_SET] = r;
+            ptr[G_OFF_SET] = g;
+            ptr[B_OFF_SET] = b;
+            cAPA012_BUF.dirty = 1;
+        }
+    }
+}
+
+void cAPA102_Load_Frame(const uint8_t *pixels)
+{
+    if (memcmp(cAPA012_BUF.pixels, pixels, 4 * cAPA012_BUF.number))
+    {
+        memcpy(cAPA012_BUF.pixels, pixels, 4 * cAPA012_BUF.number);
+        cAPA012_BUF.dirty = 1;
+    }
+}
+
 void cAPA102_Clear_All(void)
 {
     uint8_t *ptr;
     uint32_t i;
     for (ptr = cAPA012_BUF.pixels, i = 0; i < cAPA012_BUF.number; i++, ptr += 4)
     {
-        ptr[1] = 0x00;
-        ptr[2] = 0x00;
-        ptr[3] = 0x00;
+        if (ptr[1] | ptr[2] | ptr[3])
+        {
+            ptr[1] = 0x00;
+            ptr[2] = 0x00;
+            ptr[3] = 0x00;
+            cAPA012_BUF.dirty = 1;
+        }
     }
     cAPA102_Refresh();
 }
 
 void cAPA102_Refresh(void)
 {
-    int ret;
+    if (!cAPA012_BUF.dirty || !cAPA012_BUF.tx)
+    {
+        cAPA012_BUF.skipped++;
+        return;
+    }
+
+    /* A failed frame stays dirty, so the next refresh sends it again */
+    if (-1 == cAPA102_Write_Frame(cAPA012_BUF.tx))
+        return;
+    cAPA012_BUF.transfers++;
+    cAPA012_BUF.bytes += cAPA012_BUF.tx_len;
+    cAPA012_BUF.dirty = 0;
+}
+
+static int cAPA102_Write_Frame(const uint8_t *tx)
+{
+    static const char hex[] = "0123456789abcdef";
+    struct timespec now;
+    const uint8_t *ptr;
+    char *qtr;
     uint32_t i;
-    uint32_t buf_len = 4 + 4 * cAPA012_BUF.number + (cAPA012_BUF.number + 15) / 16 + 1;
-    uint8_t *ptr, *qtr;
-    uint8_t *tx = (uint8_t *)malloc(buf_len);
+    int ret;
+
+    if (cAPA102_FILE == cAPA012_BUF.backend)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        qtr = cAPA012_BUF.line + sprintf(cAPA012_BUF.line, "%lld.%06ld", (long long)now.tv_sec, now.tv_nsec / 1000);
+        for (ptr = tx + START_FRAME_LEN, i = 0; i < cAPA012_BUF.number; i++, ptr += 4)
+        {
+            *qtr++ = ' ';
+            *qtr++ = hex[ptr[R_OFF_SET] >> 4];
+            *qtr++ = hex[ptr[R_OFF_SET] & 0x0F];
+            *qtr++ = hex[ptr[G_OFF_SET] >> 4];
+            *qtr++ = hex[ptr[G_OFF_SET] & 0x0F];
+            *qtr++ = hex[ptr[B_OFF_SET] >> 4];
+            *qtr++ = hex[ptr[B_OFF_SET] & 0x0F];
+        }
+        *qtr++ = '\n';
+        if (cAPA012_BUF.is_fifo)
+            return cAPA102_Write_Fifo(cAPA012_BUF.line, qtr - cAPA012_BUF.line);
+        if (write(cAPA012_BUF.fd_spi, cAPA012_BUF.line, qtr - cAPA012_BUF.line) < 0)
+        {
+            fprintf(stdout, "[Error] can't write LED frame\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    if (cAPA102_NULL == cAPA012_BUF.backend)
+        return 0;
 
     struct spi_ioc_transfer tr = {
         .tx_buf = (unsigned long)tx,
-        .len = buf_len,
+        .len = cAPA012_BUF.tx_len,
         .speed_hz = BITRATE,
         .bits_per_word = 8,
     };
 
-    for (i = 0; i < 4; i++)
-        *(tx + i) = 0x00;
-    qtr = tx + 4;
-
-    for (ptr = cAPA012_BUF.pixels, i = 0; i < cAPA012_BUF.number; i++, ptr += 4, qtr += 4)
-    {
-        qtr[0] = cAPA012_BUF.brightness;
-        qtr[1] = ptr[1];
-        qtr[2] = ptr[2];
-        qtr[3] = ptr[3];
-    }
-
-    for (i = cAPA012_BUF.number * 4 + 4; i < buf_len; i++)
-        *(tx + i) = 0x01;
-
     ret = ioctl(cAPA012_BUF.fd_spi, SPI_IOC_MESSAGE(1), &tr);
     if (ret < 1)
+    {
         fprintf(stdout, "[Error] can't send spi message\n");
+        return -1;
+    }
+    return 0;
+}
 
-    free(tx);
+void cAPA102_Get_Stats(cAPA102_Stats *stats)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    stats->transfers = cAPA012_BUF.transfers;
+    stats->bytes = cAPA012_BUF.bytes;
+    stats->skipped = cAPA012_BUF.skipped;
+    stats->seconds = (now.tv_sec - cAPA012_BUF.since.tv_sec) + (now.tv_nsec - cAPA012_BUF.since.tv_nsec) / 1e9;
 }
 
 void cAPA102_Close(void)
@@ -162,11 +314,15 @@ void cAPA102_Close(void)
     cAPA102_Clear_All();
     if (cAPA012_BUF.fd_spi != -1)
         close(cAPA012_BUF.fd_spi);
-    if (cAPA012_BUF.pixels)
-        free(cAPA012_BUF.pixels);
+    cAPA012_BUF.fd_spi = -1;
+    free(cAPA012_BUF.tx);
+    cAPA012_BUF.tx = NULL;
+    cAPA012_BUF.pixels = NULL;
+    free(cAPA012_BUF.line);
+    cAPA012_BUF.line = NULL;
 }
 
-static int cAPA102_Try_Open_SPI_Dev(uint8_t retry_times, uint8_t retry_gap_sec, uint8_t spi_bus, uint8_t spi_dev)
+static int cAPA102_Try_Open_SPI_Dev(uint8_t retry_times, int retry_gap_ms, uint8_t spi_bus, uint8_t spi_dev)
 {
     int i, res;
     i = 0;
@@ -178,12 +334,74 @@ static int cAPA102_Try_Open_SPI_Dev(uint8_t retry_times, uint8_t retry_gap_sec,
         i++;
         if (i > retry_times)
             break;
-        fprintf(stderr, "[Error] Failed to open SPI! Retry [%d] in %d seconds. \n", i, retry_gap_sec);
-        sleep(retry_gap_sec);
+        fprintf(stderr, "[Error] Failed to open SPI! Retry [%d] in %d ms. \n", i, retry_gap_ms);
+        usleep(retry_gap_ms * 1000);
+        retry_gap_ms *= 2;
     } while (res);
     return -1;
 }
 
+static int cAPA102_Open_File(const char *path)
+{
+    struct stat st;
+    int fd_temp;
+
+    /* Opening a named pipe for writing would wait for a reader, ENXIO means there's none yet */
+    cAPA012_BUF.is_fifo = 0 == stat(path, &st) && S_ISFIFO(st.st_mode);
+    if (cAPA012_BUF.is_fifo)
+    {
+        fd_temp = open(path, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+        if (-1 == fd_temp && ENXIO != errno)
+            fprintf(stderr, "[Error] Can't open %s\n", path);
+        return fd_temp;
+    }
+
+    fd_temp = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (-1 == fd_temp)
+        fprintf(stderr, "[Error] Can't open %s\n", path);
+    return fd_temp;
+}
+
+static int cAPA102_Write_Fifo(const char *line, size_t len)
+{
+    struct timespec now, no_wait = {0, 0};
+    sigset_t pipe_set, old_set;
+    ssize_t ret;
+    int error;
+
+    if (-1 == cAPA012_BUF.fd_spi)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec < cAPA012_BUF.reopen_at)
+            return -1;
+        cAPA012_BUF.reopen_at = now.tv_sec + FIFO_REOPEN_S;
+        cAPA012_BUF.fd_spi = cAPA102_Open_File(cAPA102_OUTPUT_PATH);
+        if (-1 == cAPA012_BUF.fd_spi)
+            return -1;
+    }
+
+    /* A reader which has gone away raises SIGPIPE: keep it blocked for this write and take it back if it's pending */
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+    ret = write(cAPA012_BUF.fd_spi, line, len);
+    error = errno;
+    if (ret < 0 && EPIPE == error)
+        sigtimedwait(&pipe_set, NULL, &no_wait);
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+
+    if (ret >= 0)
+        return 0;
+    if (EAGAIN == error)
+        return -1;
+    /* Reader is gone: wait for the next one */
+    close(cAPA012_BUF.fd_spi);
+    cAPA012_BUF.fd_spi = -1;
+    if (EPIPE != error)
+        fprintf(stdout, "[Error] can't write LED frame\n");
+    return -1;
+}
+
 static int cAPA102_Open_SPI_Dev(uint8_t spi_bus, uint8_t spi_dev)
 {
     char spi_file_buff[50];
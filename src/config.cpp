@@ -1,146 +1,265 @@
 #include "config.hpp"
+#include "transport.hpp"
 
-Config::Config(const char* name)
-{
-  ifstream jStream(name);
-  data = json::parse(jStream, nullptr, false);
-  jStream.close();
-}
+#include <sys/un.h>
 
-bool Config::isRead()
-{
-  return !data.is_discarded();
-}
+static bool hasType(const json &value, const string &) { return value.is_string(); }
+static bool hasType(const json &value, const int &) { return value.is_number_integer(); }
+static bool hasType(const json &value, const double &) { return value.is_number(); }
+static bool hasType(const json &value, const bool &) { return value.is_boolean(); }
+static bool hasType(const json &value, const json &) { return value.is_object(); }
 
-// Respeaker Config
-string Config::kwsModelName()
-{
-  return data[C_RESPEAKER_STR][RSP_KWS_MODEL_STR];
-}
+static const char *typeName(const string &) { return "a string"; }
+static const char *typeName(const int &) { return "an integer"; }
+static const char *typeName(const double &) { return "a number"; }
+static const char *typeName(const bool &) { return "true or false"; }
+static const char *typeName(const json &) { return "an object"; }
 
-string Config::kwsSensitivityLevel()
+static bool isOneOf(const string &value, const vector<string> &options)
 {
-  return data[C_RESPEAKER_STR][RSP_KWS_SENSITIVITY_STR];
+  return find(options.begin(), options.end(), value) != options.end();
 }
 
-int Config::listeningTimeout()
+Config::Config(const char* name)
 {
-  return data[C_RESPEAKER_STR][RSP_LISTENING_TIMEOUT_STR];
-}
+  ifstream jStream(name);
+  json data = json::parse(jStream, nullptr, false);
+  jStream.close();
 
-int Config::gainLevel()
-{
-  return data[C_RESPEAKER_STR][RSP_GAIN_LEVEL_STR];
+  isParsed = !data.is_discarded() && data.is_object();
+  if (isParsed)
+  {
+    parse(data);
+  }
 }
 
-bool Config::doAGC()
+bool Config::isRead()
 {
-  return data[C_RESPEAKER_STR][RSP_AGC_STR];
+  return isParsed && errors.empty();
 }
 
-bool Config::doWaveLog()
+const vector<string> &Config::validationErrors()
 {
-  return data[C_RESPEAKER_STR][RSP_WAV_LOG_STR];
+  return errors;
 }
 
-bool Config::isSingleBeamOutput()
+void Config::parse(const json &data)
 {
-  return data[C_RESPEAKER_STR][RSP_SINGLE_BEAM_OUTPUT_STR];
-}
+  read(data, "", C_WS_ADDRESS_STR, values.webSocketAddress);
+  TransportAddress address;
+  check(TransportAddress::parse(values.webSocketAddress, address),
+        "webSocketAddress must be one of ws://host:port, wss://host:port, tcp://host:port, udp://host:port, unix:///path");
 
-// Pixel Ring Config
-string Config::hardwareModelName()
-{
-  return data[C_HARDWARE_STR][HW_MODEL_STR];
-}
+  // Respeaker Config
+  const json &respeaker = section(data, "", C_RESPEAKER_STR);
+  read(respeaker, C_RESPEAKER_STR, RSP_KWS_MODEL_STR, values.kwsModelName);
+  read(respeaker, C_RESPEAKER_STR, RSP_KWS_SENSITIVITY_STR, values.kwsSensitivityLevel);
+  read(respeaker, C_RESPEAKER_STR, RSP_LISTENING_TIMEOUT_STR, values.listeningTimeout);
+  read(respeaker, C_RESPEAKER_STR, RSP_WAKEWORD_DETECTION_OFFSET_STR, values.wakeWordDetectionOffset);
+  read(respeaker, C_RESPEAKER_STR, RSP_GAIN_LEVEL_STR, values.gainLevel);
+  read(respeaker, C_RESPEAKER_STR, RSP_SINGLE_BEAM_OUTPUT_STR, values.isSingleBeamOutput);
+  read(respeaker, C_RESPEAKER_STR, RSP_WAV_LOG_STR, values.doWaveLog);
+  read(respeaker, C_RESPEAKER_STR, RSP_AGC_STR, values.doAGC);
+  check(values.listeningTimeout > 0, "respeaker.listeningTimeout must be positive");
+  check(values.wakeWordDetectionOffset >= 0, "respeaker.wakeWordDetectionOffset must not be negative");
 
-string Config::idleColor()
-{
-  return data[C_PIXEL_RING_STR][PR_IDLE_COLOR_STR];
-}
+  // Streaming Config
+  const json &streaming = section(data, "", C_STREAMING_STR);
+  read(streaming, C_STREAMING_STR, ST_QUEUE_DEPTH_STR, values.queueDepth);
+  read(streaming, C_STREAMING_STR, ST_OVERFLOW_POLICY_STR, values.overflowPolicy);
+  read(streaming, C_STREAMING_STR, ST_PRE_ROLL_DURATION_STR, values.preRollDuration);
+  read(streaming, C_STREAMING_STR, ST_CODEC_STR, values.codec);
+  read(streaming, C_STREAMING_STR, ST_BITRATE_STR, values.bitrate);
+  read(streaming, C_STREAMING_STR, ST_BATCH_DURATION_STR, values.batchDuration);
+  read(streaming, C_STREAMING_STR, ST_BATCH_SIZE_STR, values.batchSize);
+  read(streaming, C_STREAMING_STR, ST_MAX_LATENCY_STR, values.maxLatency);
+  read(streaming, C_STREAMING_STR, ST_RECONNECT_MIN_DELAY_STR, values.reconnectMinDelay);
+  read(streaming, C_STREAMING_STR, ST_RECONNECT_MAX_DELAY_STR, values.reconnectMaxDelay);
+  read(streaming, C_STREAMING_STR, ST_REPLAY_BUFFER_SIZE_STR, values.replayBufferSize);
+  check(values.queueDepth > 0, "streaming.queueDepth must be positive");
+  check(isOneOf(values.overflowPolicy, {"dropOldest", "dropNewest", "block"}), "streaming.overflowPolicy must be one of dropOldest, dropNewest, block");
+  check(isOneOf(values.codec, {"pcm", "adpcm", "opus"}), "streaming.codec must be one of pcm, adpcm, opus");
+  check(values.preRollDuration >= 0 && values.batchDuration >= 0 && values.batchSize >= 0 && values.maxLatency >= 0,
+        "streaming durations and sizes must not be negative");
+  check(values.preRollDuration == 0 || values.preRollDuration > values.wakeWordDetectionOffset,
+        "streaming.preRollDuration must be either 0 or greater than respeaker.wakeWordDetectionOffset");
+  check(values.reconnectMinDelay > 0 && values.reconnectMaxDelay >= values.reconnectMinDelay,
+        "streaming.reconnectMinDelay must be positive and not greater than reconnectMaxDelay");
+  check(values.replayBufferSize >= 0, "streaming.replayBufferSize must not be negative");
 
-string Config::listenColor()
-{
-  return data[C_PIXEL_RING_STR][PR_LISTEN_COLOR_STR];
-}
+  // Voice Activity Detection Config
+  const json &vad = section(data, "", C_VAD_STR);
+  read(vad, C_VAD_STR, VAD_ENABLED_STR, values.isVadEnabled);
+  read(vad, C_VAD_STR, VAD_THRESHOLD_STR, values.vadThreshold);
+  read(vad, C_VAD_STR, VAD_TRAILING_SILENCE_STR, values.trailingSilence);
+  check(values.vadThreshold > 0, "vad.threshold must be positive");
+  check(values.trailingSilence > 0, "vad.trailingSilence must be positive");
 
-string Config::speakColor()
-{
-  return data[C_PIXEL_RING_STR][PR_SPEAK_COLOR_STR];
-}
+  // Audio Source Config
+  const json &audioSource = section(data, "", C_AUDIO_SOURCE_STR);
+  read(audioSource, C_AUDIO_SOURCE_STR, AS_TYPE_STR, values.audioSourceType);
+  read(audioSource, C_AUDIO_SOURCE_STR, AS_PATH_STR, values.audioFilePath);
+  read(audioSource, C_AUDIO_SOURCE_STR, AS_FORMAT_STR, values.audioFileFormat);
+  read(audioSource, C_AUDIO_SOURCE_STR, AS_PACING_STR, values.audioPacing);
+  read(audioSource, C_AUDIO_SOURCE_STR, AS_LOOP_STR, values.shouldLoopAudio);
+  read(audioSource, C_AUDIO_SOURCE_STR, AS_RATE_STR, values.audioFileRate);
+  read(audioSource, C_AUDIO_SOURCE_STR, AS_CHANNELS_STR, values.audioFileChannels);
+  read(audioSource, C_AUDIO_SOURCE_STR, AS_WAKE_WORD_POSITION_STR, values.wakeWordPosition);
+  check(isOneOf(values.audioSourceType, {"respeaker", "file"}), "audioSource.type must be one of respeaker, file");
+  check(isOneOf(values.audioFileFormat, {"wav", "raw"}), "audioSource.format must be one of wav, raw");
+  check(values.audioFileRate >= 1000 && values.audioFileChannels > 0, "audioSource.rate must be at least 1000 and channels positive");
 
-string Config::muteColor()
-{
-  return data[C_PIXEL_RING_STR][PR_MUTE_COLOR_STR];
-}
+  // Metrics Config
+  const json &metrics = section(data, "", C_METRICS_STR);
+  read(metrics, C_METRICS_STR, MT_REPORT_INTERVAL_STR, values.metricsReportInterval);
+  read(metrics, C_METRICS_STR, MT_DUMP_PATH_STR, values.metricsDumpPath);
+  check(values.metricsReportInterval >= 0, "metrics.reportInterval must not be negative");
 
-string Config::unmuteColor()
-{
-  return data[C_PIXEL_RING_STR][PR_UNMUTE_COLOR_STR];
-}
+  // Logging Config
+  const json &logging = section(data, "", C_LOGGING_STR);
+  read(logging, C_LOGGING_STR, LG_LEVEL_STR, values.logLevel);
+  read(logging, C_LOGGING_STR, LG_JSON_STR, values.isJsonLog);
+  check(isOneOf(values.logLevel, {"error", "info", "debug"}), "logging.level must be one of error, info, debug");
 
-bool Config::isIdleAnimationEnabled()
-{
-  return data[C_PIXEL_RING_STR][PR_ON_IDLE_STR];
-}
+  // Transcripts Config
+  const json &transcripts = section(data, "", C_TRANSCRIPTS_STR);
+  read(transcripts, C_TRANSCRIPTS_STR, TR_SOCKET_PATH_STR, values.transcriptSocketPath);
+  check(values.transcriptSocketPath.size() < sizeof(sockaddr_un::sun_path), "transcripts.socketPath is too long");
 
-bool Config::isListenAnimationEnabled()
-{
-  return data[C_PIXEL_RING_STR][PR_ON_LISTEN_STR];
-}
+  // Shared Memory Config
+  const json &sharedMemory = section(data, "", C_SHARED_MEMORY_STR);
+  read(sharedMemory, C_SHARED_MEMORY_STR, SHM_SOCKET_PATH_STR, values.sharedMemorySocketPath);
+  read(sharedMemory, C_SHARED_MEMORY_STR, SHM_CAPACITY_STR, values.sharedMemoryCapacity);
+  check(values.sharedMemorySocketPath.size() < sizeof(sockaddr_un::sun_path), "sharedMemory.socketPath is too long");
+  check(values.sharedMemoryCapacity >= 4096 && (values.sharedMemoryCapacity & (values.sharedMemoryCapacity - 1)) == 0,
+        "sharedMemory.capacity must be a power of two, at least 4096");
 
-bool Config::isSpeakAnimationEnabled()
-{
-  return data[C_PIXEL_RING_STR][PR_ON_SPEAK_STR];
-}
+  // Pixel Ring Config
+  const json &pixelRing = section(data, "", C_PIXEL_RING_STR);
+  read(pixelRing, C_PIXEL_RING_STR, PR_LED_BRI_STR, values.brightness);
+  read(pixelRing, C_PIXEL_RING_STR, PR_FRAME_RATE_STR, values.frameRate);
+  read(pixelRing, C_PIXEL_RING_STR, PR_ANIMATIONS_STR, values.animations);
+  read(pixelRing, C_PIXEL_RING_STR, PR_DOA_INDICATOR_STR, values.isDoaIndicatorEnabled);
+  read(pixelRing, C_PIXEL_RING_STR, PR_DOA_UPDATE_INTERVAL_STR, values.doaUpdateInterval);
+  read(pixelRing, C_PIXEL_RING_STR, PR_DOA_SMOOTHING_STR, values.doaSmoothing);
+  read(pixelRing, C_PIXEL_RING_STR, PR_ON_IDLE_STR, values.isIdleAnimationEnabled);
+  read(pixelRing, C_PIXEL_RING_STR, PR_ON_LISTEN_STR, values.isListenAnimationEnabled);
+  read(pixelRing, C_PIXEL_RING_STR, PR_ON_SPEAK_STR, values.isSpeakAnimationEnabled);
+  read(pixelRing, C_PIXEL_RING_STR, PR_TO_MUTE_STR, values.isMuteAnimationEnabled);
+  read(pixelRing, C_PIXEL_RING_STR, PR_TO_UNMUTE_STR, values.isUnmuteAnimationEnabled);
+  read(pixelRing, C_PIXEL_RING_STR, PR_IDLE_COLOR_STR, values.idleColor);
+  read(pixelRing, C_PIXEL_RING_STR, PR_LISTEN_COLOR_STR, values.listenColor);
+  read(pixelRing, C_PIXEL_RING_STR, PR_SPEAK_COLOR_STR, values.speakColor);
+  read(pixelRing, C_PIXEL_RING_STR, PR_MUTE_COLOR_STR, values.muteColor);
+  read(pixelRing, C_PIXEL_RING_STR, PR_UNMUTE_COLOR_STR, values.unmuteColor);
+  read(pixelRing, C_PIXEL_RING_STR, PR_MUTE_STR, values.shouldMute);
+  check(values.brightness >= 0 && values.brightness <= 255, "pixelRing.ledBrightness must be in 0..255");
+  check(values.frameRate > 0 && values.frameRate <= 1000, "pixelRing.frameRate must be in 1..1000");
+  check(values.doaUpdateInterval > 0, "pixelRing.doaUpdateInterval must be positive");
+  check(values.doaSmoothing > 0 && values.doaSmoothing <= 1, "pixelRing.doaSmoothing must be in (0, 1]");
+  checkAnimations(values.animations);
 
-bool Config::isMuteAnimationEnabled()
-{
-  return data[C_PIXEL_RING_STR][PR_TO_MUTE_STR];
+  // Hardware Config
+  const json &hardware = section(data, "", C_HARDWARE_STR);
+  read(hardware, C_HARDWARE_STR, HW_MODEL_STR, values.hardwareModelName);
+  read(hardware, C_HARDWARE_STR, HW_LED_NUM, values.ledsAmount);
+  read(hardware, C_HARDWARE_STR, HW_LED_SPI_BUS, values.spiBusNumber);
+  read(hardware, C_HARDWARE_STR, HW_LED_SPI_DEV, values.spiDevNumber);
+  read(hardware, C_HARDWARE_STR, HW_LED_BACKEND, values.ledBackend);
+  read(hardware, C_HARDWARE_STR, HW_LED_OUTPUT, values.ledOutputPath);
+  const json &power = section(hardware, C_HARDWARE_STR, HW_POWER_STR);
+  read(power, C_HARDWARE_STR "." HW_POWER_STR, HW_GPIO_PIN, values.powerPin);
+  read(power, C_HARDWARE_STR "." HW_POWER_STR, HW_GPIO_VAL, values.powerPinValue);
+  check(values.ledsAmount > 0 && values.ledsAmount <= 255, "hardware.ledsAmount must be in 1..255");
+  check(isOneOf(values.ledBackend, {"spidev", "file", "null"}), "hardware.ledBackend must be one of spidev, file, null");
 }
 
-bool Config::isUnmuteAnimationEnabled()
+/**
+ * Missing section keeps defaults for all of its keys.
+ */
+const json &Config::section(const json &data, const string &path, const char *name)
 {
-  return data[C_PIXEL_RING_STR][PR_TO_UNMUTE_STR];
+  static const json empty = json::object();
+  auto found = data.find(name);
+  if (found == data.end() || found->is_null())
+  {
+    return empty;
+  }
+  check(found->is_object(), (path.empty() ? name : path + "." + name) + " must be an object");
+  return found->is_object() ? *found : empty;
 }
 
-bool Config::shouldMute()
+template <typename T>
+void Config::read(const json &section, const string &path, const char *key, T &value)
 {
-  return data[C_PIXEL_RING_STR][PR_MUTE_STR];
-}
+  auto field = section.find(key);
+  if (field == section.end() || field->is_null())
+  {
+    return;
+  }
 
-int Config::brightness()
-{
-  return data[C_PIXEL_RING_STR][PR_LED_BRI_STR];
+  string name = path.empty() ? key : path + "." + key;
+  if (!hasType(*field, value))
+  {
+    errors.push_back(name + " must be " + typeName(value));
+    return;
+  }
+  value = field->template get<T>();
 }
 
-int Config::ledsAmount()
+/**
+ * Keyframes are compiled on the pixel ring thread, which has no way to report a malformed definition but to crash.
+ */
+void Config::checkAnimations(const json &animations)
 {
-  return data[C_HARDWARE_STR][HW_LED_NUM];
-}
+  for (auto &animation : animations.items())
+  {
+    string path = string(C_PIXEL_RING_STR "." PR_ANIMATIONS_STR ".") + animation.key();
+    const json &definition = animation.value();
+    if (!definition.is_object())
+    {
+      errors.push_back(path + " must be an object");
+      continue;
+    }
 
-int Config::spiBusNumber()
-{
-  return data[C_HARDWARE_STR][HW_LED_SPI_BUS];
-}
+    auto keyframes = definition.find(KF_KEYFRAMES_STR);
+    if (keyframes == definition.end() || !keyframes->is_array() || keyframes->empty())
+    {
+      errors.push_back(path + "." KF_KEYFRAMES_STR " must be a non-empty array");
+      continue;
+    }
+    check(!definition.contains(KF_LOOP_STR) || definition[KF_LOOP_STR].is_boolean(), path + "." KF_LOOP_STR " must be true or false");
 
-int Config::spiDevNumber()
-{
-  return data[C_HARDWARE_STR][HW_LED_SPI_DEV];
-}
+    int previousTime = 0;
+    for (auto &keyframe : *keyframes)
+    {
+      if (!keyframe.is_object())
+      {
+        errors.push_back(path + "." KF_KEYFRAMES_STR " must be objects");
+        break;
+      }
 
-int Config::powerPin()
-{
-  return data[C_HARDWARE_STR][HW_POWER_STR][HW_GPIO_PIN];
-}
-
-int Config::powerPinValue()
-{
-  return data[C_HARDWARE_STR][HW_POWER_STR][HW_GPIO_VAL];
+      const json time = keyframe.value(KF_TIME_STR, json(0));
+      const json colors = keyframe.value(KF_COLORS_STR, json());
+      const json easing = keyframe.value(KF_EASING_STR, json("linear"));
+      bool hasColors = colors.is_array() && !colors.empty() &&
+                       all_of(colors.begin(), colors.end(), [](const json &color) { return color.is_string(); });
+      if (!time.is_number_integer() || time.get<int>() < previousTime || !hasColors || !easing.is_string() ||
+          !isOneOf(easing.get<string>(), {"linear", "step", "easeIn", "easeOut", "easeInOut"}))
+      {
+        errors.push_back(path + "." KF_KEYFRAMES_STR " must go in time order from 0 ms, each with a non-empty array of colors "
+                         "and an easing of linear, step, easeIn, easeOut or easeInOut");
+        break;
+      }
+      previousTime = time.get<int>();
+    }
+  }
 }
 
-// WebSocket Config
-string Config::webSocketAddress()
+void Config::check(bool isValid, const string &error)
 {
-  return data[C_WS_ADDRESS_STR];
+  if (!isValid)
+  {
+    errors.push_back(error);
+  }
 }
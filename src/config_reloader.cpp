@@ -0,0 +1,153 @@
+#include "config_reloader.hpp"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+extern "C"
+{
+#include "verbose.h"
+}
+
+ConfigReloader::ConfigReloader(const string &path, Config *config)
+    : path(path), snapshot(config), generation(0), isRunning(false), wakeupFd(-1), inotifyFd(-1)
+{
+}
+
+ConfigReloader::~ConfigReloader()
+{
+  stop();
+}
+
+bool ConfigReloader::start()
+{
+  wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wakeupFd == -1)
+  {
+    return false;
+  }
+
+  // Editors often save by renaming a temporary file over the original one, so the whole directory is watched.
+  size_t slash = path.rfind('/');
+  string directory = slash == string::npos ? "." : path.substr(0, slash + 1);
+  inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotifyFd == -1 || inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) == -1)
+  {
+    verbose(V_NORMAL, stderr, "Unable to watch %s, it's reloaded on SIGHUP only", path.c_str());
+    if (inotifyFd != -1)
+    {
+      close(inotifyFd);
+      inotifyFd = -1;
+    }
+  }
+
+  isRunning = true;
+  watcher = thread(&ConfigReloader::watch, this);
+  return true;
+}
+
+void ConfigReloader::stop()
+{
+  if (!isRunning.exchange(false))
+  {
+    return;
+  }
+
+  requestReload();
+  watcher.join();
+  close(wakeupFd);
+  if (inotifyFd != -1)
+  {
+    close(inotifyFd);
+  }
+  wakeupFd = inotifyFd = -1;
+}
+
+/**
+ * Only a non-blocking eventfd write, so it's safe to call from a signal handler.
+ */
+void ConfigReloader::requestReload()
+{
+  uint64_t value = 1;
+  if (wakeupFd != -1)
+  {
+    write(wakeupFd, &value, sizeof(value));
+  }
+}
+
+shared_ptr<Config> ConfigReloader::current()
+{
+  return atomic_load(&snapshot);
+}
+
+/**
+ * Bumped after each published snapshot: a cheap check for the audio loop.
+ */
+uint64_t ConfigReloader::version()
+{
+  return generation.load(memory_order_acquire);
+}
+
+void ConfigReloader::watch()
+{
+  size_t slash = path.rfind('/');
+  string name = slash == string::npos ? path : path.substr(slash + 1);
+  struct pollfd fds[2] = {{wakeupFd, POLLIN, 0}, {inotifyFd, POLLIN, 0}};
+  alignas(inotify_event) char events[4096];
+  uint64_t value;
+
+  while (isRunning)
+  {
+    if (poll(fds, inotifyFd == -1 ? 1 : 2, -1) <= 0 || !isRunning)
+    {
+      continue;
+    }
+
+    bool isRequested = read(wakeupFd, &value, sizeof(value)) > 0;
+    bool isChanged = false;
+    ssize_t length;
+    while (inotifyFd != -1 && (length = read(inotifyFd, events, sizeof(events))) > 0)
+    {
+      for (char *next = events; next < events + length;)
+      {
+        inotify_event *event = (inotify_event *)next;
+        isChanged |= event->len > 0 && name == event->name;
+        next += sizeof(inotify_event) + event->len;
+      }
+    }
+
+    if (isChanged)
+    {
+      // Let the writer finish: events of a single save end up in one reload.
+      this_thread::sleep_for(chrono::milliseconds(RELOAD_SETTLE_MS));
+      while (read(inotifyFd, events, sizeof(events)) > 0)
+      {
+      }
+    }
+
+    if (isRequested || isChanged)
+    {
+      reload();
+    }
+  }
+}
+
+void ConfigReloader::reload()
+{
+  Config *config = new Config(path.c_str());
+  if (!config->isRead())
+  {
+    for (const string &error : config->validationErrors())
+    {
+      verbose(V_NORMAL, stderr, "Invalid config: %s", error.c_str());
+    }
+    verbose(V_NORMAL, stderr, "Unable to reload %s, keeping the current config", path.c_str());
+    delete config;
+    return;
+  }
+
+  atomic_store(&snapshot, shared_ptr<Config>(config));
+  generation.fetch_add(1, memory_order_release);
+  verbose(VV_INFO, stdout, "Config is reloaded from %s", path.c_str());
+}
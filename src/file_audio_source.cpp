@@ -0,0 +1,207 @@
+#include "file_audio_source.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+extern "C"
+{
+#include "verbose.h"
+}
+
+static uint32_t readLE32(const unsigned char *data)
+{
+  return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static uint16_t readLE16(const unsigned char *data)
+{
+  return data[0] | (data[1] << 8);
+}
+
+FileAudioSource::FileAudioSource(Config *config)
+{
+  path = config->audioFilePath();
+  isWav = config->audioFileFormat() == "wav";
+  isRealtime = config->audioPacing() == "realtime";
+  shouldLoop = config->shouldLoopAudio() && path != STDIN_PATH;
+  sampleRate = config->audioFileRate();
+  channelCount = config->audioFileChannels();
+  file = nullptr;
+  interrupt = nullptr;
+  replayedBytes = 0;
+
+  if (!open())
+  {
+    verbose(V_NORMAL, stderr, "Unable to open audio file %s", path.c_str());
+  }
+
+  size_t bytesPerMs = sampleRate / 1000 * channelCount * sizeof(int16_t);
+  blockBytes = BLOCK_SIZE_MS * bytesPerMs;
+  wakeWordPosition = config->wakeWordPosition() * bytesPerMs;
+}
+
+FileAudioSource::~FileAudioSource()
+{
+  if (file != nullptr && file != stdin)
+  {
+    fclose(file);
+  }
+}
+
+/**
+ * (Re)open the input and skip to the beginning of audio data.
+ */
+bool FileAudioSource::open()
+{
+  if (path == STDIN_PATH)
+  {
+    file = stdin;
+  }
+  else
+  {
+    file = file == nullptr ? fopen(path.c_str(), "rb") : freopen(path.c_str(), "rb", file);
+  }
+
+  position = 0;
+  isWakeWordReported = false;
+  dataSize = numeric_limits<size_t>::max();
+
+  return file != nullptr && (!isWav || readWavHeader());
+}
+
+/**
+ * Parse RIFF header sequentially (so it works for stdin too) and stop at the beginning of "data" chunk.
+ */
+bool FileAudioSource::readWavHeader()
+{
+  unsigned char header[WAV_HEADER_SIZE];
+  if (fread(header, 1, WAV_HEADER_SIZE, file) != WAV_HEADER_SIZE || memcmp(header, "RIFF", 4) || memcmp(header + 8, "WAVE", 4))
+  {
+    verbose(V_NORMAL, stderr, "%s is not a WAV file", path.c_str());
+    return false;
+  }
+
+  unsigned char chunkHeader[WAV_CHUNK_HEADER_SIZE];
+  while (fread(chunkHeader, 1, WAV_CHUNK_HEADER_SIZE, file) == WAV_CHUNK_HEADER_SIZE)
+  {
+    uint32_t chunkSize = readLE32(chunkHeader + 4);
+
+    if (!memcmp(chunkHeader, "data", 4))
+    {
+      dataSize = chunkSize;
+      return true;
+    }
+    else if (!memcmp(chunkHeader, "fmt ", 4) && chunkSize >= 16)
+    {
+      unsigned char format[16];
+      if (fread(format, 1, sizeof(format), file) != sizeof(format))
+      {
+        break;
+      }
+      if (readLE16(format) != WAV_PCM_FORMAT || readLE16(format + 14) != 16)
+      {
+        verbose(V_NORMAL, stderr, "Only 16-bit PCM WAV files are supported");
+        return false;
+      }
+      channelCount = readLE16(format + 2);
+      sampleRate = readLE32(format + 4);
+      chunkSize -= sizeof(format);
+    }
+
+    // Chunks are word aligned.
+    if (!skip(chunkSize + (chunkSize & 1)))
+    {
+      break;
+    }
+  }
+
+  verbose(V_NORMAL, stderr, "%s has no audio data", path.c_str());
+  return false;
+}
+
+bool FileAudioSource::skip(size_t size)
+{
+  char buffer[256];
+  while (size > 0)
+  {
+    size_t count = fread(buffer, 1, min(size, sizeof(buffer)), file);
+    if (count == 0)
+    {
+      return false;
+    }
+    size -= count;
+  }
+  return true;
+}
+
+bool FileAudioSource::startListening(bool *interrupt)
+{
+  this->interrupt = interrupt;
+  startTime = SteadyClock::now();
+  return file != nullptr;
+}
+
+int FileAudioSource::channels()
+{
+  return channelCount;
+}
+
+int FileAudioSource::rate()
+{
+  return sampleRate;
+}
+
+int FileAudioSource::soundDirection()
+{
+  return 0;
+}
+
+void FileAudioSource::stopAudioProcessing()
+{
+  verbose(VV_INFO, stdout, "Replayed %llu bytes of audio", (unsigned long long)replayedBytes);
+}
+
+/**
+ * Read the next block. When input is over, either start over or ask the main loop to stop.
+ */
+void FileAudioSource::processAudio(AudioChunk &chunk, int &detected)
+{
+  detected = 0;
+  chunk.data.resize(blockBytes);
+
+  size_t count = fread(&chunk.data[0], 1, min(blockBytes, dataSize - position), file);
+  if (count == 0 && shouldLoop && open())
+  {
+    count = fread(&chunk.data[0], 1, min(blockBytes, dataSize - position), file);
+  }
+  chunk.data.resize(count);
+
+  if (count == 0)
+  {
+    if (interrupt != nullptr)
+    {
+      *interrupt = true;
+    }
+    chunk.captureTime = SteadyClock::now();
+    return;
+  }
+
+  position += count;
+  replayedBytes += count;
+  if (!isWakeWordReported && position > wakeWordPosition)
+  {
+    isWakeWordReported = true;
+    detected = 1;
+  }
+
+  // Real-time pacing: deliver blocks at the rate they would come from a microphone.
+  if (isRealtime)
+  {
+    uint64_t replayedMs = replayedBytes * 1000 / (sampleRate * channelCount * sizeof(int16_t));
+    this_thread::sleep_until(startTime + chrono::milliseconds(replayedMs));
+  }
+  chunk.captureTime = SteadyClock::now();
+}
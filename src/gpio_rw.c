@@ -42,6 +42,26 @@ int cGPIO_unexport(int pin)
     return (0);
 }
 
+int cGPIO_wait_ready(int pin, int timeout_ms)
+{
+    char path[DIRECTION_MAX];
+    int waited_ms;
+
+    snprintf(path, DIRECTION_MAX, "/sys/class/gpio/gpio%d/direction", pin);
+    for (waited_ms = 0; -1 == access(path, W_OK); waited_ms += GPIO_POLL_MS)
+    {
+        if (waited_ms >= timeout_ms)
+        {
+            verbose(V_NORMAL, stderr, BLUE "[%s]" NONE " Pin %d isn't ready in %d ms!", __FUNCTION__, pin, timeout_ms);
+            return (-1);
+        }
+        usleep(GPIO_POLL_MS * 1000);
+    }
+
+    verbose(VVV_DEBUG, stdout, BLUE "[%s]" NONE " Pin %d is ready in %d ms", __FUNCTION__, pin, waited_ms);
+    return (0);
+}
+
 int cGPIO_direction(int pin, int dir)
 {
     static const char s_directions_str[] = "in\0out";
@@ -0,0 +1,188 @@
+#include "latency_tracker.hpp"
+
+#include <cmath>
+#include <cstdio>
+
+#include "json.hpp"
+
+extern "C"
+{
+#include "verbose.h"
+}
+
+#ifndef APP_VERSION
+#define APP_VERSION "unknown"
+#endif
+
+using json = nlohmann::json;
+
+static const char *MARK_NAMES[LATENCY_MARKS_NUM] = {"wakeWord", "firstEnqueued", "firstSent", "firstPartial", "finalResult"};
+
+static int64_t toNanos(TimePoint time)
+{
+  return chrono::duration_cast<chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+  {
+    buckets[i] = 0;
+  }
+  count = 0;
+  max = 0;
+}
+
+void LatencyHistogram::record(double ms)
+{
+  int bucket = 0;
+  if (ms > HISTOGRAM_MIN_MS)
+  {
+    bucket = (int)ceil(log(ms / HISTOGRAM_MIN_MS) / log(HISTOGRAM_GROWTH));
+    bucket = bucket >= HISTOGRAM_BUCKETS ? HISTOGRAM_BUCKETS - 1 : bucket;
+  }
+  buckets[bucket]++;
+  count++;
+  max = ms > max ? ms : max;
+}
+
+/**
+ * Upper bound of the bucket which holds the given percentile (0-100).
+ */
+double LatencyHistogram::percentile(double p)
+{
+  uint64_t rank = (uint64_t)ceil(count * p / 100);
+  uint64_t seen = 0;
+
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+  {
+    seen += buckets[i];
+    if (seen >= rank && seen > 0)
+    {
+      double bound = HISTOGRAM_MIN_MS * pow(HISTOGRAM_GROWTH, i);
+      return bound < max ? bound : max;
+    }
+  }
+  return 0;
+}
+
+uint64_t LatencyHistogram::samples()
+{
+  return count;
+}
+
+double LatencyHistogram::maximum()
+{
+  return max;
+}
+
+LatencyTracker::LatencyTracker(int reportInterval, const string &dumpPath)
+{
+  for (int i = 0; i < LATENCY_MARKS_NUM; i++)
+  {
+    marks[i] = 0;
+  }
+  this->reportInterval = chrono::seconds(reportInterval);
+  this->dumpPath = dumpPath;
+  lastReportTime = SteadyClock::now();
+}
+
+/**
+ * Start a new utterance.
+ */
+void LatencyTracker::begin(TimePoint wakeWordTime)
+{
+  for (int i = 1; i < LATENCY_MARKS_NUM; i++)
+  {
+    marks[i].store(0, memory_order_relaxed);
+  }
+  marks[WAKE_WORD].store(toNanos(wakeWordTime), memory_order_release);
+}
+
+/**
+ * Timestamp the first occurrence of an event within the current utterance. Lock-free, safe to call from any thread.
+ */
+void LatencyTracker::mark(LatencyMark mark)
+{
+  if (marks[WAKE_WORD].load(memory_order_acquire) == 0 || marks[mark].load(memory_order_relaxed) != 0)
+  {
+    return;
+  }
+
+  int64_t expected = 0;
+  marks[mark].compare_exchange_strong(expected, toNanos(SteadyClock::now()), memory_order_relaxed);
+}
+
+/**
+ * Close the current utterance: record what happened into histograms and report them periodically.
+ */
+void LatencyTracker::finish()
+{
+  int64_t wakeWordTime = marks[WAKE_WORD].exchange(0, memory_order_acq_rel);
+  if (wakeWordTime == 0)
+  {
+    return;
+  }
+
+  for (int i = 1; i < LATENCY_MARKS_NUM; i++)
+  {
+    int64_t time = marks[i].load(memory_order_relaxed);
+    if (time >= wakeWordTime)
+    {
+      histograms[i].record((time - wakeWordTime) / 1e6);
+    }
+  }
+
+  if (SteadyClock::now() - lastReportTime >= reportInterval)
+  {
+    lastReportTime = SteadyClock::now();
+    report();
+    dump();
+  }
+}
+
+void LatencyTracker::report()
+{
+  char line[512];
+  int length = 0;
+
+  for (int i = 1; i < LATENCY_MARKS_NUM && length < (int)sizeof(line); i++)
+  {
+    LatencyHistogram &histogram = histograms[i];
+    length += snprintf(line + length, sizeof(line) - length, " %s: p50=%.0f p95=%.0f p99=%.0f (n=%llu);", MARK_NAMES[i],
+                       histogram.percentile(50), histogram.percentile(95), histogram.percentile(99), (unsigned long long)histogram.samples());
+  }
+  verbose(VV_INFO, stdout, "Latency since wake word, ms:%s", line);
+}
+
+/**
+ * Write histograms' summary as JSON, so it could be compared across firmware versions.
+ */
+void LatencyTracker::dump()
+{
+  if (dumpPath.empty())
+  {
+    return;
+  }
+
+  json summary = {{"version", APP_VERSION}};
+  for (int i = 1; i < LATENCY_MARKS_NUM; i++)
+  {
+    LatencyHistogram &histogram = histograms[i];
+    summary["latency"][MARK_NAMES[i]] = {
+        {"count", histogram.samples()},
+        {"p50", histogram.percentile(50)},
+        {"p95", histogram.percentile(95)},
+        {"p99", histogram.percentile(99)},
+        {"max", histogram.maximum()}};
+  }
+
+  FILE *file = fopen(dumpPath.c_str(), "w");
+  if (file == nullptr)
+  {
+    verbose(V_NORMAL, stderr, "Unable to write latency dump to %s", dumpPath.c_str());
+    return;
+  }
+  fputs(summary.dump(2).c_str(), file);
+  fclose(file);
+}
@@ -1,41 +1,153 @@
 #include "main.hpp"
 
-void enablePixelRing(Config* config)
+/**
+ * Size of 1 ms of processed audio: 16-bit samples for each output channel.
+ */
+size_t bytesPerMs()
+{
+  return audioSource->rate() / 1000 * audioSource->channels() * sizeof(int16_t);
+}
+
+/**
+ * How fast we reacted to the end of speech and how long the server took to finalize the transcribe.
+ */
+void logEndOfSpeechLatency(TimePoint speechEndTime, TimePoint endOfStreamTime)
+{
+  long long endOfStreamLatency = chrono::duration_cast<chrono::milliseconds>(endOfStreamTime - speechEndTime).count();
+  if (asrClient->isTranscribeReceived())
+  {
+    long long transcribeLatency = chrono::duration_cast<chrono::milliseconds>(asrClient->transcribeReceivedTime() - speechEndTime).count();
+    verbose(VV_INFO, stdout, "End of speech latency: EOF sent in %lld ms, final transcribe in %lld ms.", endOfStreamLatency, transcribeLatency);
+  }
+  else
+  {
+    verbose(VV_INFO, stdout, "End of speech latency: EOF sent in %lld ms, no final transcribe.", endOfStreamLatency);
+  }
+}
+
+/**
+ * How long it took the audio loop to end a session after the final transcribe had arrived on the transport thread.
+ */
+void logTranscribeReaction(TimePoint transcribeTime)
+{
+  static uint64_t reactions = 0;
+  static long long reactionSumUs = 0, reactionMaxUs = 0;
+
+  long long reactionUs = chrono::duration_cast<chrono::microseconds>(SteadyClock::now() - transcribeTime).count();
+  reactions++;
+  reactionSumUs += reactionUs;
+  reactionMaxUs = max(reactionMaxUs, reactionUs);
+  verbose(VV_INFO, stdout, "Transcribe is handled in %lld us (%lld us avg, %lld us max).", reactionUs,
+          reactionSumUs / (long long)reactions, reactionMaxUs);
+}
+
+/**
+ * Log transport counters at the end of a listening session.
+ */
+void logStreamingStats(TimePoint detectTime)
+{
+  static uint64_t sentFrames = 0, sentBytes = 0;
+
+  double sessionSeconds = chrono::duration<double>(SteadyClock::now() - detectTime).count();
+  FrameStats frames = asrClient->frameStats();
+  if (frames.frames > sentFrames)
+  {
+    verbose(VV_INFO, stdout, "Frames: %.1f/s, %llu bytes/frame.", (frames.frames - sentFrames) / sessionSeconds,
+            (unsigned long long)((frames.bytes - sentBytes) / (frames.frames - sentFrames)));
+  }
+  sentFrames = frames.frames;
+  sentBytes = frames.bytes;
+
+  AudioQueueStats stats = asrClient->queueStats();
+  verbose(VV_INFO, stdout, "Audio queue: high-water mark = %zu/%zu, queued = %llu, copied = %llu, dropped = %llu.",
+          stats.highWaterMark, stats.capacity, (unsigned long long)stats.pushed, (unsigned long long)stats.copied,
+          (unsigned long long)stats.dropped);
+
+  EncoderStats encoding = asrClient->encoderStats();
+  if (encoding.blocks > 0 && encoding.outputBytes > 0)
+  {
+    verbose(VV_INFO, stdout, "Encoder %s: %.1f us/block, compression ratio = %.1fx.", encoding.codec.c_str(),
+            (double)encoding.encodeMicros / encoding.blocks, (double)encoding.inputBytes / encoding.outputBytes);
+  }
+
+  ReconnectStats connection = asrClient->reconnectStats();
+  verbose(VV_INFO, stdout, "Connection: reconnects = %llu, buffered = %llu bytes (peak %llu), dropped utterances = %llu.",
+          (unsigned long long)connection.reconnects, (unsigned long long)connection.bufferedBytes,
+          (unsigned long long)connection.peakBufferedBytes, (unsigned long long)connection.droppedUtterances);
+}
+
+/**
+ * Power pin, SPI and LED animations. Doesn't depend on the audio chain, so it runs in parallel with its setup.
+ */
+bool enablePixelRing(Config* config)
 {
   setupPixelRing(config);
 
   if (-1 == setPowerPin())
-    cleanup(EXIT_FAILURE);
-
-  RUNTIME.curr_state = RUNTIME.if_mute ? TO_MUTE : TO_UNMUTE;
-  RUNTIME.if_update = 1;
+    return false;
 
+  cAPA102_Set_Backend((cAPA102_BACKEND)RUNTIME.LEDs.backend, RUNTIME.LEDs.output);
   if (-1 == cAPA102_Init(RUNTIME.LEDs.number,
                          RUNTIME.LEDs.spi_bus,
                          RUNTIME.LEDs.spi_dev,
                          GLOBAL_BRIGHTNESS))
-    cleanup(EXIT_FAILURE);
+    return false;
+
+  compileAnimations(config, RUNTIME.keyframes);
+  changePixelRingState(RUNTIME.if_mute ? TO_MUTE : TO_UNMUTE);
+  return -1 != state_machine_start();
+}
 
-  // It makes no sense to continue if WS is unavailable.
-  wsClient = new WsTransport();
-  if (!wsClient->connect(config->webSocketAddress()))
+/**
+ * Server may come up later: the transport connects and keeps reconnecting in the background.
+ */
+void connectToAsrServer(Config* config)
+{
+  size_t blockBytes = BLOCK_SIZE_MS * bytesPerMs();
+  asrClient = new AsrClient(config, latencyTracker, blockBytes, audioSource->rate(), audioSource->channels());
+  asrClient->connect(config->webSocketAddress());
+}
+
+/**
+ * Processed audio is also published to a shared memory ring for co-located consumers, when it's configured.
+ */
+void openAudioRing(Config* config)
+{
+  audioRing = new ShmAudioRing(config->sharedMemorySocketPath(), config->sharedMemoryCapacity());
+  if (!config->sharedMemorySocketPath().empty() && !audioRing->open(audioSource->rate(), audioSource->channels()))
   {
-    verbose(VV_INFO, stdout, "Unable to connect to WS server. Quitting...");
-    cleanup(EXIT_FAILURE);
+    verbose(V_NORMAL, stderr, "Unable to open shared audio ring, audio is only streamed to the ASR server");
   }
 }
 
+/**
+ * How long each startup phase took. Pixel ring is set up in parallel with the audio source.
+ */
+void logStartupTimes(TimePoint startTime, TimePoint configTime, chrono::nanoseconds audioSourceDuration, chrono::nanoseconds pixelRingDuration)
+{
+  auto ms = [](chrono::nanoseconds duration) { return (long long)chrono::duration_cast<chrono::milliseconds>(duration).count(); };
+  verbose(VV_INFO, stdout, "Startup: config = %lld ms, audio source = %lld ms, pixel ring = %lld ms (in parallel), ready in %lld ms.",
+          ms(configTime - startTime), ms(audioSourceDuration), ms(pixelRingDuration), ms(SteadyClock::now() - startTime));
+}
+
 /**
  * Exit program and release all the resources.
  */
 void cleanup(int status)
 {
-  if (wsClient != nullptr) {
-    wsClient->disconnect();
+  if (configReloader != nullptr) {
+    configReloader->stop();
   }
+  if (asrClient != nullptr) {
+    asrClient->disconnect();
+  }
+  if (audioRing != nullptr) {
+    audioRing->close();
+  }
+  state_machine_stop();
   resetPowerPin();
   cAPA102_Close();
-  pthread_cancel(RUNTIME.curr_thread);
+  verbose_stop();
   exit(status);
 }
 
@@ -44,10 +156,20 @@ void cleanup(int status)
  */
 void handleQuit(int signal)
 {
-  verbose(VV_INFO, stdout, "Caught signal %d. Terminating...", signal);
+  caughtSignal = signal;
   shouldStopListening = true;
   RUNTIME.if_terminate = 1;
-  pthread_cancel(RUNTIME.curr_thread);
+}
+
+/**
+ * Config is re-read on a background thread, the handler only wakes it up.
+ */
+void handleReload(int signal)
+{
+  if (configReloader != nullptr)
+  {
+    configReloader->requestReload();
+  }
 }
 
 void configureSignalHandler()
@@ -58,67 +180,247 @@ void configureSignalHandler()
   sig_int_handler.sa_flags = 0;
   sigaction(SIGINT, &sig_int_handler, NULL);
   sigaction(SIGTERM, &sig_int_handler, NULL);
+
+  struct sigaction sig_hup_handler;
+  sig_hup_handler.sa_handler = handleReload;
+  sigemptyset(&sig_hup_handler.sa_mask);
+  sig_hup_handler.sa_flags = SA_RESTART;
+  sigaction(SIGHUP, &sig_hup_handler, NULL);
+}
+
+/**
+ * Apply a reloaded config without interrupting audio: only settings which don't need the DSP chain or the transport to be rebuilt.
+ * Listening timeout is read from the active config on every block, so it's picked up as is.
+ */
+void applyConfig(Config *previous, Config *next)
+{
+  audioSource->reconfigure(next);
+  reloadPixelRing(next);
+
+  if (next->kwsModelName() != previous->kwsModelName() || next->kwsSensitivityLevel() != previous->kwsSensitivityLevel())
+  {
+    verbose(VV_INFO, stdout, "Hotword model and sensitivity changes take effect after restart.");
+  }
+  if (next->webSocketAddress() != previous->webSocketAddress())
+  {
+    verbose(VV_INFO, stdout, "ASR server address changes take effect after restart.");
+  }
+}
+
+/**
+ * Switch to asynchronous logging, so that the audio loop never waits for stdout.
+ */
+void configureLogging(Config* config)
+{
+  string level = config->logLevel();
+  setVerbose(level == "debug" ? VVV_DEBUG : level == "error" ? V_NORMAL : VV_INFO);
+  setVerboseFormat(config->isJsonLog() ? VERBOSE_JSON : VERBOSE_TEXT);
+
+  if (-1 == verbose_start())
+  {
+    verbose(V_NORMAL, stderr, "Unable to start log writer thread, logging synchronously");
+  }
 }
 
 int main(int argc, char *argv[])
 {
+  TimePoint startTime = SteadyClock::now();
   configureSignalHandler();
   setVerbose(VV_INFO);
   
   config = new Config(CONFIG_FILE);
   if (!config->isRead())
   {
+    for (const string &error : config->validationErrors())
+    {
+      verbose(V_NORMAL, stderr, "Invalid config: %s", error.c_str());
+    }
     verbose(VV_INFO, stdout, "Unable to read json config. Quitting...");
     exit(EXIT_FAILURE);
   }
+  configureLogging(config);
+  configReloader = new ConfigReloader(CONFIG_FILE, config);
+  latencyTracker = new LatencyTracker(config->metricsReportInterval(), config->metricsDumpPath());
+  TimePoint configTime = SteadyClock::now();
+
+  bool isPixelRingEnabled = false;
+  chrono::nanoseconds pixelRingDuration;
+  thread pixelRingSetup([&]() {
+    isPixelRingEnabled = enablePixelRing(config);
+    pixelRingDuration = SteadyClock::now() - configTime;
+  });
+
+  audioSource = createAudioSource(config);
+  bool isListening = audioSource != nullptr && audioSource->startListening(&shouldStopListening);
+  chrono::nanoseconds audioSourceDuration = SteadyClock::now() - configTime;
+  if (isListening)
+  {
+    connectToAsrServer(config);
+    openAudioRing(config);
+  }
 
-  respeakerCore = new RespeakerCore(config);
-  if (!respeakerCore->startListening(&shouldStopListening))
+  pixelRingSetup.join();
+  if (!isListening)
   {
-    verbose(VV_INFO, stdout, "Unable to start the respeaker node chain. Quitting...");
+    verbose(VV_INFO, stdout, audioSource == nullptr ? "Unable to create audio source. Quitting..." : "Unable to start the audio source. Quitting...");
     cleanup(EXIT_FAILURE);
   }
-  else
+  if (!isPixelRingEnabled)
   {
-    enablePixelRing(config);
-    verbose(VV_INFO, stdout, "Press CTRL-C to exit");
+    verbose(VV_INFO, stdout, "Unable to enable pixel ring. Quitting...");
+    cleanup(EXIT_FAILURE);
   }
+  logStartupTimes(startTime, configTime, audioSourceDuration, pixelRingDuration);
+  verbose(VV_INFO, stdout, "Press CTRL-C to exit");
+
+  preRoll = new PreRollBuffer(config->preRollDuration() * bytesPerMs());
+  size_t trimBytes = config->wakeWordDetectionOffset() * bytesPerMs();
 
   int wakeWordIndex = 0, direction = 0;
   TimePoint detectTime;
-  string audioChunk;
+  AudioChunk audioChunk, preRollChunk;
+
+  bool isVadEnabled = config->isVadEnabled();
+  bool isEndOfStreamSent = false;
+  TimePoint endOfStreamTime;
+
+  bool isDoaIndicatorEnabled = config->isDoaIndicatorEnabled();
+  chrono::milliseconds doaUpdateInterval(config->doaUpdateInterval());
+  TimePoint directionTime;
+
+  vad = new VoiceActivityDetector(config->vadThreshold(), config->trailingSilence(), BLOCK_SIZE_MS);
+
+  // The active snapshot is only swapped here, between audio blocks. The previous one is released with the last reference.
+  shared_ptr<Config> activeConfig = configReloader->current();
+  uint64_t configVersion = configReloader->version();
+  if (!configReloader->start())
+  {
+    verbose(V_NORMAL, stderr, "Unable to start config watcher, config won't be reloaded");
+  }
 
   while (!shouldStopListening && trackPixelRingState())
   {
-    audioChunk = respeakerCore->processAudio(wakeWordIndex);
+    if (configReloader->version() != configVersion)
+    {
+      configVersion = configReloader->version();
+      shared_ptr<Config> next = configReloader->current();
+      applyConfig(activeConfig.get(), next.get());
+      activeConfig = next;
+      config = activeConfig.get();
+      isVadEnabled = config->isVadEnabled();
+      isDoaIndicatorEnabled = config->isDoaIndicatorEnabled();
+      doaUpdateInterval = chrono::milliseconds(config->doaUpdateInterval());
+    }
+
+    audioSource->processAudio(audioChunk, wakeWordIndex);
+    audioRing->acceptReaders();
+
+    if (isVadEnabled)
+    {
+      vad->process(audioChunk);
+    }
+
+    // Keep the most recent audio while idle: it's the pre-roll of the next utterance.
+    if (!isWakeWordDetected || wakeWordIndex >= 1)
+    {
+      preRoll->write(audioChunk.data);
+    }
 
     if (wakeWordIndex >= 1)
     {
       isWakeWordDetected = true;
-      wsClient->isTranscribed(false);
+      isEndOfStreamSent = false;
+      vad->reset();
+      asrClient->isTranscribed(false);
       detectTime = SteadyClock::now();
-      direction = respeakerCore->soundDirection();
+      latencyTracker->begin(detectTime);
+      direction = audioSource->soundDirection();
+      asrClient->startOfStream(direction);
+      audioRing->startOfStream(direction);
       verbose(VV_INFO, stdout, "Wake word is detected, direction = %d.", direction);
-      changePixelRingState(TO_UNMUTE);
+      if (isDoaIndicatorEnabled)
+      {
+        directionTime = detectTime;
+        changePixelRingDirection(direction);
+        changePixelRingState(ON_LISTEN);
+      }
+      else
+      {
+        changePixelRingState(TO_UNMUTE);
+      }
+
+      // The oldest part of the pre-roll contains a hotword which we don't wanna get a transcribe for.
+      // The rest is sent in one burst, as the user may start talking right after the wake word.
+      preRoll->flush(preRollChunk, trimBytes);
+      if (!preRollChunk.data.empty())
+      {
+        audioRing->send(preRollChunk);
+        asrClient->send(move(preRollChunk));
+        latencyTracker->mark(FIRST_ENQUEUED);
+      }
     } else {
-      cout << "." << flush;
+      verbose_rl(5000, VVV_DEBUG, stdout, "Listening...");
+    }
+
+    // Follow the speaker while listening. The render thread picks up the latest value on its own pace.
+    if (isWakeWordDetected && isDoaIndicatorEnabled && SteadyClock::now() - directionTime >= doaUpdateInterval)
+    {
+      directionTime = SteadyClock::now();
+      changePixelRingDirection(audioSource->soundDirection());
     }
 
-    // Skip the chunk with a hotword to avoid sending it for transciption.
-    if (isWakeWordDetected && wakeWordIndex < 1 && wsClient->isConnected())
+    // The chunk with a hotword is already a part of the pre-roll.
+    // Blocks are queued even if the connection is not ready yet: the sender thread buffers them for a replay.
+    if (isWakeWordDetected && wakeWordIndex < 1 && !isEndOfStreamSent)
     {
-      wsClient->send(audioChunk);
+      // Ring readers get the samples before the chunk's buffer is moved to the sender thread.
+      audioRing->send(audioChunk);
+      asrClient->send(move(audioChunk));
+      latencyTracker->mark(FIRST_ENQUEUED);
+
+      // Don't stream silence until timeout: ask the server for a final transcribe as soon as the user stops talking.
+      if (isVadEnabled && vad->isUtteranceEnded())
+      {
+        asrClient->endOfStream();
+        audioRing->endOfStream();
+        isEndOfStreamSent = true;
+        endOfStreamTime = SteadyClock::now();
+        verbose(VV_INFO, stdout, "End of speech is detected.");
+      }
     }
 
-    // Reset wake word detection flag when wait timeout occurs or if we received a final transcribe from WS server.
-    if (isWakeWordDetected && ((SteadyClock::now() - detectTime) > chrono::milliseconds(config->listeningTimeout()) || wsClient->isTranscribeReceived()))
+    // Reset wake word detection flag when wait timeout occurs or if we received a final transcribe from ASR server.
+    // The event is taken after the wake word handling above, which discards a late transcribe of the previous session.
+    bool isTranscribeReceived = asrClient->takeTranscribe();
+    if (isWakeWordDetected && ((SteadyClock::now() - detectTime) > chrono::milliseconds(config->listeningTimeout()) || isTranscribeReceived))
     {
       isWakeWordDetected = false;
-      wsClient->isTranscribed(false);
       changePixelRingState(TO_MUTE);
+      if (isTranscribeReceived)
+      {
+        logTranscribeReaction(asrClient->transcribeReceivedTime());
+      }
+
+      if (isEndOfStreamSent)
+      {
+        logEndOfSpeechLatency(vad->lastSpeechTime(), endOfStreamTime);
+      }
+      else
+      {
+        // ASR server gets the EOF of a timed out utterance only when the next one starts, but ring readers have no other way to know it's over.
+        audioRing->endOfStream();
+      }
+      asrClient->isTranscribed(false);
+      logStreamingStats(detectTime);
+      latencyTracker->finish();
     }
   }
 
-  respeakerCore->stopAudioProcessing();
+  if (caughtSignal)
+  {
+    verbose(VV_INFO, stdout, "Caught signal %d. Terminating...", (int)caughtSignal);
+  }
+
+  audioSource->stopAudioProcessing();
   cleanup(EXIT_SUCCESS);
 }
@@ -0,0 +1,71 @@
+#include "pre_roll_buffer.hpp"
+
+#include <algorithm>
+
+PreRollBuffer::PreRollBuffer(size_t capacity)
+{
+  this->capacity = capacity;
+  buffer.resize(capacity);
+  head = 0;
+  length = 0;
+}
+
+/**
+ * Append audio overwriting the oldest samples.
+ */
+void PreRollBuffer::write(const string &audio)
+{
+  if (capacity == 0)
+  {
+    return;
+  }
+
+  const char *data = audio.data();
+  size_t size = audio.size();
+
+  // Only the tail of a block which is larger than the whole buffer matters.
+  if (size > capacity)
+  {
+    data += size - capacity;
+    size = capacity;
+  }
+
+  size_t tail = (head + length) % capacity;
+  size_t firstPart = min(size, capacity - tail);
+  buffer.replace(tail, firstPart, data, firstPart);
+  buffer.replace(0, size - firstPart, data + firstPart, size - firstPart);
+
+  length += size;
+  if (length > capacity)
+  {
+    head = (head + length - capacity) % capacity;
+    length = capacity;
+  }
+}
+
+/**
+ * Move buffered audio (oldest to newest) into the chunk skipping the oldest trimBytes, then clear the buffer.
+ */
+void PreRollBuffer::flush(AudioChunk &chunk, size_t trimBytes)
+{
+  chunk.data.clear();
+  chunk.captureTime = SteadyClock::now();
+
+  if (trimBytes < length)
+  {
+    size_t start = (head + trimBytes) % capacity;
+    size_t size = length - trimBytes;
+    size_t firstPart = min(size, capacity - start);
+    chunk.data.reserve(size);
+    chunk.data.append(buffer, start, firstPart);
+    chunk.data.append(buffer, 0, size - firstPart);
+  }
+
+  clear();
+}
+
+void PreRollBuffer::clear()
+{
+  head = 0;
+  length = 0;
+}
@@ -11,7 +11,8 @@ RespeakerCore::RespeakerCore(Config* config)
   beamformingNode.reset(VepAecBeamformingNode::Create(CIRCULAR_6MIC_7BEAM, config->isSingleBeamOutput(), 6, config->doWaveLog()));
   hotwordNode.reset(SnowboyMbDoaKwsNode::Create(kwsResourcesPath, kwsModelPath, config->kwsSensitivityLevel(), 10, config->doAGC()));
   
-  if (config->doAGC()) {
+  isAgcEnabled = config->doAGC();
+  if (isAgcEnabled) {
     hotwordNode->SetAgcTargetLevelDbfs(config->gainLevel());
   }
   hotwordNode->DisableAutoStateTransfer();
@@ -42,9 +43,15 @@ int RespeakerCore::rate()
   return respeaker->GetNumOutputRate();
 }
 
-string RespeakerCore::processAudio(int& detected)
+/**
+ * Move the processed block into the chunk: librespeaker's output buffer is handed over as is. DetectHotword returns
+ * a new string per block, and moving it in frees the spare buffer the queue has handed back: one allocation per block
+ * we can't avoid without librespeaker writing into a caller's buffer.
+ */
+void RespeakerCore::processAudio(AudioChunk& chunk, int& detected)
 {
-  return respeaker->DetectHotword(detected);
+  chunk.data = respeaker->DetectHotword(detected);
+  chunk.captureTime = SteadyClock::now();
 }
 
 int RespeakerCore::soundDirection()
@@ -56,3 +63,13 @@ void RespeakerCore::stopAudioProcessing()
 {
   respeaker->Stop();
 }
+
+/**
+ * Hotword sensitivity and AGC itself are only taken by the node's factory, while AGC target level has a setter.
+ */
+void RespeakerCore::reconfigure(Config* config)
+{
+  if (isAgcEnabled) {
+    hotwordNode->SetAgcTargetLevelDbfs(config->gainLevel());
+  }
+}
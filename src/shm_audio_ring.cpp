@@ -0,0 +1,461 @@
+#include "shm_audio_ring.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <linux/memfd.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+extern "C"
+{
+#include "verbose.h"
+}
+
+static size_t alignRecord(size_t size)
+{
+  return (size + SHM_ALIGNMENT - 1) & ~(size_t)(SHM_ALIGNMENT - 1);
+}
+
+static size_t dataOffset()
+{
+  return (sizeof(ShmRingHeader) + 63) & ~(size_t)63;
+}
+
+/**
+ * Futex word lives in a shared mapping, so the process-private futex flavour can't be used.
+ */
+static uint32_t *futexWord(const ShmRingHeader *header)
+{
+  return (uint32_t *)&header->sequence;
+}
+
+ShmAudioRing::ShmAudioRing(const string &socketPath, size_t capacity)
+    : socketPath(socketPath), capacity(capacity), memFd(-1), listenFd(-1), mappingSize(0), header(nullptr), data(nullptr),
+      utterance(0), direction(-1)
+{
+}
+
+ShmAudioRing::~ShmAudioRing()
+{
+  close();
+}
+
+bool ShmAudioRing::open(int sampleRate, int channels)
+{
+  // Older glibc has no wrapper for memfd_create.
+  memFd = syscall(SYS_memfd_create, "respeaker-audio", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  mappingSize = dataOffset() + capacity;
+  if (memFd == -1 || ftruncate(memFd, mappingSize) == -1)
+  {
+    verbose(V_NORMAL, stderr, "Unable to create shared audio ring: %s", strerror(errno));
+    close();
+    return false;
+  }
+
+  void *mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+  if (mapping == MAP_FAILED)
+  {
+    verbose(V_NORMAL, stderr, "Unable to map shared audio ring: %s", strerror(errno));
+    close();
+    return false;
+  }
+  // Readers map the same fd, so it's sealed: a reader which shrinks it would crash the writer with SIGBUS.
+  fcntl(memFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+  header = new (mapping) ShmRingHeader();
+  header->magic = SHM_RING_MAGIC;
+  header->version = SHM_RING_VERSION;
+  header->capacity = capacity;
+  header->sampleRate = sampleRate;
+  header->channels = channels;
+  header->dataOffset = dataOffset();
+  data = (char *)mapping + dataOffset();
+
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+  // Only a socket left by a previous run is removed: anything else at the path isn't ours.
+  struct stat node;
+  if (lstat(socketPath.c_str(), &node) == 0)
+  {
+    if (!S_ISSOCK(node.st_mode))
+    {
+      verbose(V_NORMAL, stderr, "Unable to listen for shared audio readers on %s: it exists and isn't a socket", socketPath.c_str());
+      close();
+      return false;
+    }
+    unlink(socketPath.c_str());
+  }
+
+  listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listenFd == -1 || bind(listenFd, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(listenFd, SHM_BACKLOG) == -1)
+  {
+    verbose(V_NORMAL, stderr, "Unable to listen for shared audio readers on %s: %s", socketPath.c_str(), strerror(errno));
+    // The path wasn't bound by us, so close() mustn't unlink it.
+    if (listenFd != -1)
+    {
+      ::close(listenFd);
+      listenFd = -1;
+    }
+    close();
+    return false;
+  }
+
+  verbose(VV_INFO, stdout, "Audio is published to a %zu bytes shared ring, readers connect on %s", capacity, socketPath.c_str());
+  return true;
+}
+
+void ShmAudioRing::close()
+{
+  if (listenFd != -1)
+  {
+    ::close(listenFd);
+    unlink(socketPath.c_str());
+    listenFd = -1;
+  }
+  if (header != nullptr)
+  {
+    munmap(header, mappingSize);
+    header = nullptr;
+    data = nullptr;
+  }
+  if (memFd != -1)
+  {
+    ::close(memFd);
+    memFd = -1;
+  }
+}
+
+/**
+ * Records carry the block's capture time; the pre-roll's is the time of the wake word detection.
+ */
+void ShmAudioRing::send(const AudioChunk &audioChunk)
+{
+  send(AudioView{audioChunk.data.data(), audioChunk.data.size()}, audioChunk.captureTime);
+}
+
+/**
+ * Audio longer than a quarter of the ring (a pre-roll burst) is split, so that a record never takes a reader's whole lag budget.
+ */
+void ShmAudioRing::send(const AudioView &audio, TimePoint captureTime)
+{
+  if (header == nullptr)
+  {
+    return;
+  }
+
+  size_t frameBytes = header->channels * sizeof(int16_t);
+  size_t maxPayload = capacity / 4 - sizeof(ShmRecord);
+  maxPayload -= maxPayload % frameBytes;
+
+  for (size_t offset = 0; offset < audio.size; offset += maxPayload)
+  {
+    write(SHM_AUDIO, audio.data + offset, min(maxPayload, audio.size - offset), captureTime);
+  }
+}
+
+void ShmAudioRing::startOfStream(int direction)
+{
+  this->utterance++;
+  this->direction = direction;
+  write(SHM_START_OF_STREAM, nullptr, 0, SteadyClock::now());
+}
+
+void ShmAudioRing::endOfStream()
+{
+  write(SHM_END_OF_STREAM, nullptr, 0, SteadyClock::now());
+}
+
+/**
+ * Called between audio blocks, so no thread is needed to wait for readers; the socket is only checked a few times a second.
+ * A reader gets the memfd with the position to start reading from and is disconnected, everything else goes through the mapping.
+ */
+void ShmAudioRing::acceptReaders()
+{
+  if (listenFd == -1)
+  {
+    return;
+  }
+
+  TimePoint now = SteadyClock::now();
+  if (now < nextAcceptTime)
+  {
+    return;
+  }
+  nextAcceptTime = now + chrono::milliseconds(SHM_ACCEPT_INTERVAL);
+
+  int reader;
+  while ((reader = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC)) != -1)
+  {
+    uint64_t position = header->writePosition.load(memory_order_relaxed);
+    struct iovec vector = {&position, sizeof(position)};
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    struct cmsghdr *rights = CMSG_FIRSTHDR(&message);
+    rights->cmsg_level = SOL_SOCKET;
+    rights->cmsg_type = SCM_RIGHTS;
+    rights->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(rights), &memFd, sizeof(int));
+
+    if (sendmsg(reader, &message, MSG_DONTWAIT | MSG_NOSIGNAL) == sizeof(position))
+    {
+      verbose(VVV_DEBUG, stdout, "Shared audio reader is connected");
+    }
+    ::close(reader);
+  }
+}
+
+/**
+ * Space is reserved before a record is written, so that readers could tell whether what they've just read was overwritten
+ * (seqlock style). A record which doesn't fit before the end of the data area starts from its beginning instead.
+ */
+void ShmAudioRing::write(ShmRecordKind kind, const char *payload, size_t size, TimePoint captureTime)
+{
+  if (header == nullptr)
+  {
+    return;
+  }
+
+  size_t recordSize = alignRecord(sizeof(ShmRecord) + size);
+  uint64_t position = header->reservedPosition.load(memory_order_relaxed);
+  size_t offset = position & (capacity - 1);
+  size_t tail = capacity - offset;
+  size_t skipped = recordSize > tail ? tail : 0;
+
+  header->reservedPosition.store(position + skipped + recordSize, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  // Readers skip a tail which is too short for a record header on their own.
+  if (skipped > 0 && tail >= sizeof(ShmRecord))
+  {
+    ShmRecord padding = {0, SHM_PADDING, 0, 0, 0, 0};
+    memcpy(data + offset, &padding, sizeof(padding));
+  }
+  if (skipped > 0)
+  {
+    offset = 0;
+  }
+
+  ShmRecord record = {(uint32_t)size, (uint16_t)kind, (int16_t)direction, utterance, 0,
+                      (int64_t)chrono::duration_cast<chrono::nanoseconds>(captureTime.time_since_epoch()).count()};
+  memcpy(data + offset, &record, sizeof(record));
+  if (size > 0)
+  {
+    memcpy(data + offset + sizeof(record), payload, size);
+  }
+
+  publish(position + skipped + recordSize);
+}
+
+/**
+ * Wake syscall is only made when a reader sleeps. Both sides use sequentially consistent operations on the sequence and
+ * the waiters counter, so either the writer sees a waiter, or the waiter's futex call sees the new sequence and returns.
+ */
+void ShmAudioRing::publish(uint64_t position)
+{
+  header->writePosition.store(position, memory_order_release);
+  header->sequence.fetch_add(1);
+  if (header->waiters.load() > 0)
+  {
+    syscall(SYS_futex, futexWord(header), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+  }
+}
+
+ShmAudioReader::ShmAudioReader() : memFd(-1), mappingSize(0), header(nullptr), data(nullptr), position(0), recordPosition(0), overruns(0)
+{
+}
+
+ShmAudioReader::~ShmAudioReader()
+{
+  close();
+}
+
+/**
+ * Receive the ring's memfd from the writer and map it. Reading starts from the record written next after the writer accepts us,
+ * which takes up to SHM_ACCEPT_INTERVAL.
+ */
+bool ShmAudioReader::connect(const string &socketPath)
+{
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+  int socketFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (socketFd == -1 || ::connect(socketFd, (struct sockaddr *)&address, sizeof(address)) == -1)
+  {
+    if (socketFd != -1)
+    {
+      ::close(socketFd);
+    }
+    return false;
+  }
+
+  uint64_t start;
+  struct iovec vector = {&start, sizeof(start)};
+  char control[CMSG_SPACE(sizeof(int))];
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &vector;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  ssize_t received = recvmsg(socketFd, &message, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+  ::close(socketFd);
+  struct cmsghdr *rights = CMSG_FIRSTHDR(&message);
+  if (received != sizeof(start) || rights == nullptr || rights->cmsg_type != SCM_RIGHTS)
+  {
+    return false;
+  }
+  memcpy(&memFd, CMSG_DATA(rights), sizeof(int));
+
+  // Readers write to the waiters counter, so the mapping can't be read-only.
+  struct stat status;
+  void *mapping = MAP_FAILED;
+  if (fstat(memFd, &status) == 0 && (size_t)status.st_size > sizeof(ShmRingHeader))
+  {
+    mappingSize = status.st_size;
+    mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+  }
+  if (mapping == MAP_FAILED)
+  {
+    close();
+    return false;
+  }
+
+  header = (ShmRingHeader *)mapping;
+  if (header->magic != SHM_RING_MAGIC || header->version != SHM_RING_VERSION || header->dataOffset + header->capacity > mappingSize)
+  {
+    close();
+    return false;
+  }
+  data = (const char *)mapping + header->dataOffset;
+  // Records written since the writer has accepted us are not missed.
+  position = start;
+  return true;
+}
+
+void ShmAudioReader::close()
+{
+  if (header != nullptr)
+  {
+    munmap(header, mappingSize);
+    header = nullptr;
+    data = nullptr;
+  }
+  if (memFd != -1)
+  {
+    ::close(memFd);
+    memFd = -1;
+  }
+}
+
+/**
+ * Next record, or nullptr when nothing is written within the timeout. A reader which has been lapped by the writer
+ * counts an overrun and continues from the latest record.
+ */
+const ShmRecord *ShmAudioReader::next(chrono::milliseconds timeout)
+{
+  if (header == nullptr)
+  {
+    return nullptr;
+  }
+
+  uint64_t capacity = header->capacity;
+  TimePoint deadline = SteadyClock::now() + timeout;
+  while (true)
+  {
+    uint32_t sequence = header->sequence.load();
+    uint64_t written = header->writePosition.load(memory_order_acquire);
+    if (written - position > capacity)
+    {
+      overruns++;
+      position = written;
+    }
+
+    if (position != written)
+    {
+      size_t offset = position & (capacity - 1);
+      size_t tail = capacity - offset;
+      if (tail < sizeof(ShmRecord))
+      {
+        position += tail;
+        continue;
+      }
+
+      const ShmRecord *record = (const ShmRecord *)(data + offset);
+      uint32_t size = record->size;
+      uint16_t kind = record->kind;
+      atomic_thread_fence(memory_order_acquire);
+      if (header->reservedPosition.load(memory_order_relaxed) - position > capacity || alignRecord(sizeof(ShmRecord) + size) > tail)
+      {
+        overruns++;
+        position = header->writePosition.load(memory_order_acquire);
+        continue;
+      }
+
+      if (kind == SHM_PADDING)
+      {
+        position += tail;
+        continue;
+      }
+      recordPosition = position;
+      position += alignRecord(sizeof(ShmRecord) + size);
+      return record;
+    }
+
+    chrono::nanoseconds remaining = deadline - SteadyClock::now();
+    if (remaining.count() <= 0)
+    {
+      return nullptr;
+    }
+
+    struct timespec wait = {(time_t)(remaining.count() / 1000000000), (long)(remaining.count() % 1000000000)};
+    header->waiters.fetch_add(1);
+    if (header->writePosition.load() == position)
+    {
+      syscall(SYS_futex, futexWord(header), FUTEX_WAIT, sequence, &wait, nullptr, 0);
+    }
+    header->waiters.fetch_sub(1);
+  }
+}
+
+/**
+ * Whether the last returned record is still intact: the writer hasn't reserved its space for anything newer.
+ */
+bool ShmAudioReader::isValid()
+{
+  atomic_thread_fence(memory_order_acquire);
+  return header != nullptr && header->reservedPosition.load(memory_order_relaxed) - recordPosition <= header->capacity;
+}
+
+uint64_t ShmAudioReader::overrunCount()
+{
+  return overruns;
+}
+
+const ShmRingHeader *ShmAudioReader::ring()
+{
+  return header;
+}
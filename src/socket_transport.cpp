@@ -0,0 +1,428 @@
+#include "socket_transport.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+extern "C"
+{
+#include "verbose.h"
+}
+
+SocketTransport::SocketTransport(const TransportAddress &address, int socketType) : socketType(socketType), address(address), fd(-1)
+{
+  stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+SocketTransport::~SocketTransport()
+{
+  stop();
+  if (stopFd != -1)
+  {
+    close(stopFd);
+  }
+}
+
+void SocketTransport::start()
+{
+  if (!receiver.joinable())
+  {
+    receiver = thread(&SocketTransport::run, this);
+  }
+}
+
+void SocketTransport::stop()
+{
+  if (!receiver.joinable())
+  {
+    return;
+  }
+
+  uint64_t value = 1;
+  if (write(stopFd, &value, sizeof(value)) == -1)
+  {
+    verbose(V_NORMAL, stderr, "Unable to wake up transport receiver: %s", strerror(errno));
+  }
+  receiver.join();
+  // Clear the request, so the transport could be started again.
+  if (read(stopFd, &value, sizeof(value)) == -1)
+  {
+    value = 0;
+  }
+}
+
+/**
+ * Receiver thread: a failed connection is only logged, the ASR client retries on its own schedule.
+ */
+void SocketTransport::run()
+{
+  int socket = connectSocket();
+  if (socket == -1)
+  {
+    return;
+  }
+
+  {
+    lock_guard<mutex> lock(sendMutex);
+    fd = socket;
+  }
+  bool isOpen = handshake();
+  if (isOpen)
+  {
+    onOpen();
+    receive();
+  }
+
+  {
+    lock_guard<mutex> lock(sendMutex);
+    close(fd);
+    fd = -1;
+  }
+  if (isOpen)
+  {
+    onClose();
+  }
+}
+
+/**
+ * A connected stream is ready to use as is.
+ */
+bool SocketTransport::handshake()
+{
+  return true;
+}
+
+/**
+ * Connect without blocking the stop request. The socket is switched to blocking mode after that, with a send timeout,
+ * so that a stalled server can't hold the sender thread forever.
+ */
+int SocketTransport::connectSocket()
+{
+  vector<struct sockaddr_storage> targets;
+  vector<socklen_t> targetSizes;
+
+  if (address.scheme == "unix")
+  {
+    struct sockaddr_storage target;
+    struct sockaddr_un *local = (struct sockaddr_un *)&target;
+    memset(&target, 0, sizeof(target));
+    local->sun_family = AF_UNIX;
+    strncpy(local->sun_path, address.path.c_str(), sizeof(local->sun_path) - 1);
+    targets.push_back(target);
+    targetSizes.push_back(sizeof(struct sockaddr_un));
+  }
+  else
+  {
+    struct addrinfo hints, *results;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = socketType;
+    int status = getaddrinfo(address.host.c_str(), to_string(address.port).c_str(), &hints, &results);
+    if (status != 0)
+    {
+      verbose_rl(5000, V_NORMAL, stderr, "Unable to resolve %s: %s", address.host.c_str(), gai_strerror(status));
+      return -1;
+    }
+    for (struct addrinfo *result = results; result != nullptr; result = result->ai_next)
+    {
+      struct sockaddr_storage target;
+      memcpy(&target, result->ai_addr, result->ai_addrlen);
+      targets.push_back(target);
+      targetSizes.push_back(result->ai_addrlen);
+    }
+    freeaddrinfo(results);
+  }
+
+  for (size_t i = 0; i < targets.size(); i++)
+  {
+    int socket = ::socket(targets[i].ss_family, socketType | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (socket == -1)
+    {
+      continue;
+    }
+
+    int error = 0;
+    socklen_t errorSize = sizeof(error);
+    if (connect(socket, (struct sockaddr *)&targets[i], targetSizes[i]) == -1)
+    {
+      error = errno;
+      if (error == EINPROGRESS && waitForSocket(socket, POLLOUT, TRANSPORT_CONNECTION_TIMEOUT))
+      {
+        getsockopt(socket, SOL_SOCKET, SO_ERROR, &error, &errorSize);
+      }
+    }
+    if (error != 0)
+    {
+      verbose_rl(5000, VVV_DEBUG, stdout, "Unable to connect to ASR server: %s", strerror(error));
+      close(socket);
+      continue;
+    }
+
+    fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) & ~O_NONBLOCK);
+    struct timeval timeout = {TRANSPORT_SEND_TIMEOUT / 1000, TRANSPORT_SEND_TIMEOUT % 1000 * 1000};
+    setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (socketType == SOCK_STREAM && address.scheme == "tcp")
+    {
+      // Frames are already coalesced by the ASR client, Nagle would only delay them.
+      int noDelay = 1;
+      setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    }
+    return socket;
+  }
+  return -1;
+}
+
+/**
+ * Returns false on a stop request or timeout.
+ */
+bool SocketTransport::waitForSocket(int socket, short events, int timeout)
+{
+  struct pollfd fds[2] = {{socket, events, 0}, {stopFd, POLLIN, 0}};
+  while (poll(fds, 2, timeout) == -1)
+  {
+    if (errno != EINTR)
+    {
+      return false;
+    }
+  }
+  return !(fds[1].revents & POLLIN) && fds[0].revents != 0;
+}
+
+bool SocketTransport::waitReadable(int timeout)
+{
+  return waitForSocket(fd, POLLIN, timeout);
+}
+
+bool SocketTransport::isStopRequested()
+{
+  struct pollfd stop = {stopFd, POLLIN, 0};
+  return poll(&stop, 1, 0) > 0;
+}
+
+StreamTransport::StreamTransport(const TransportAddress &address) : SocketTransport(address, SOCK_STREAM)
+{
+}
+
+/**
+ * Receiver thread calls back into this class, so it has to be stopped before the base destructor.
+ */
+StreamTransport::~StreamTransport()
+{
+  stop();
+}
+
+string StreamTransport::name()
+{
+  return address.scheme == "unix" ? "Unix socket" : "TCP";
+}
+
+bool StreamTransport::sendBinary(const string &payload)
+{
+  return sendMessage(TRANSPORT_BINARY, payload);
+}
+
+bool StreamTransport::sendText(const string &text)
+{
+  return sendMessage(TRANSPORT_TEXT, text);
+}
+
+/**
+ * Header and payload go out in one syscall, without copying the payload. A failed or timed out send breaks the stream,
+ * so the connection is shut down: the receiver thread notices that and reports it as closed.
+ */
+bool StreamTransport::sendMessage(TransportMessageType type, const string &payload)
+{
+  uint32_t length = payload.size() + 1;
+  char header[5] = {(char)length, (char)(length >> 8), (char)(length >> 16), (char)(length >> 24), (char)type};
+  struct iovec parts[2] = {{header, sizeof(header)}, {(void *)payload.data(), payload.size()}};
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = parts;
+  message.msg_iovlen = 2;
+
+  lock_guard<mutex> lock(sendMutex);
+  if (fd == -1)
+  {
+    return false;
+  }
+
+  size_t remaining = sizeof(header) + payload.size();
+  while (remaining > 0)
+  {
+    ssize_t sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+    if (sent == -1 && errno == EINTR)
+    {
+      continue;
+    }
+    if (sent <= 0)
+    {
+      verbose_rl(5000, V_NORMAL, stderr, "Unable to send to ASR server: %s", strerror(errno));
+      shutdown(fd, SHUT_RDWR);
+      return false;
+    }
+
+    remaining -= sent;
+    while (message.msg_iovlen > 0 && (size_t)sent >= message.msg_iov->iov_len)
+    {
+      sent -= message.msg_iov->iov_len;
+      message.msg_iov++;
+      message.msg_iovlen--;
+    }
+    if (message.msg_iovlen > 0)
+    {
+      message.msg_iov->iov_base = (char *)message.msg_iov->iov_base + sent;
+      message.msg_iov->iov_len -= sent;
+    }
+  }
+  return true;
+}
+
+/**
+ * Server messages are cut out of a receive buffer, so a few small ones cost a single syscall.
+ */
+void StreamTransport::receive()
+{
+  char chunk[TRANSPORT_RECEIVE_BUFFER];
+  buffer.clear();
+
+  while (waitReadable())
+  {
+    ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+    if (received == -1 && errno == EINTR)
+    {
+      continue;
+    }
+    if (received <= 0)
+    {
+      return;
+    }
+    buffer.append(chunk, received);
+
+    size_t offset = 0;
+    while (buffer.size() - offset >= 4)
+    {
+      const unsigned char *header = (const unsigned char *)buffer.data() + offset;
+      uint32_t length = header[0] | header[1] << 8 | header[2] << 16 | (uint32_t)header[3] << 24;
+      if (length == 0 || length > TRANSPORT_MAX_MESSAGE)
+      {
+        verbose(V_NORMAL, stderr, "Malformed message from ASR server, length = %u", length);
+        return;
+      }
+      if (buffer.size() - offset - 4 < length)
+      {
+        break;
+      }
+
+      if (header[4] == TRANSPORT_TEXT)
+      {
+        onMessage(buffer.substr(offset + 5, length - 1));
+      }
+      offset += 4 + length;
+    }
+    buffer.erase(0, offset);
+  }
+}
+
+DatagramTransport::DatagramTransport(const TransportAddress &address) : SocketTransport(address, SOCK_DGRAM), datagram(UDP_MAX_PAYLOAD + 1)
+{
+}
+
+DatagramTransport::~DatagramTransport()
+{
+  stop();
+}
+
+string DatagramTransport::name()
+{
+  return "UDP";
+}
+
+bool DatagramTransport::sendBinary(const string &payload)
+{
+  for (size_t offset = 0; offset < payload.size(); offset += UDP_MAX_PAYLOAD)
+  {
+    if (!sendDatagram(TRANSPORT_BINARY, payload.data() + offset, min(payload.size() - offset, (size_t)UDP_MAX_PAYLOAD)))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool DatagramTransport::sendText(const string &text)
+{
+  return sendDatagram(TRANSPORT_TEXT, text.data(), text.size());
+}
+
+bool DatagramTransport::sendDatagram(TransportMessageType type, const char *payload, size_t size)
+{
+  char header = (char)type;
+  struct iovec parts[2] = {{&header, 1}, {(void *)payload, size}};
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = parts;
+  message.msg_iovlen = 2;
+
+  lock_guard<mutex> lock(sendMutex);
+  return fd != -1 && sendmsg(fd, &message, 0) == (ssize_t)(size + 1);
+}
+
+/**
+ * UDP connect() only sets the peer address and always succeeds, so the server is asked to answer with any datagram.
+ * Hellos are repeated in case one is lost. Port unreachable means the server isn't up yet: the ASR client retries later.
+ */
+bool DatagramTransport::handshake()
+{
+  for (int elapsed = 0; elapsed < TRANSPORT_CONNECTION_TIMEOUT && !isStopRequested(); elapsed += UDP_HELLO_INTERVAL)
+  {
+    sendDatagram(TRANSPORT_TEXT, UDP_HELLO_MESSAGE, strlen(UDP_HELLO_MESSAGE));
+    if (!waitReadable(UDP_HELLO_INTERVAL))
+    {
+      continue;
+    }
+
+    ssize_t received = recv(fd, datagram.data(), datagram.size(), 0);
+    if (received > 0)
+    {
+      return true;
+    }
+    if (received == -1 && errno != EINTR)
+    {
+      verbose_rl(5000, VVV_DEBUG, stdout, "Unable to connect to ASR server: %s", strerror(errno));
+      return false;
+    }
+  }
+  return false;
+}
+
+/**
+ * ICMP port unreachable is reported as ECONNREFUSED: the server has gone away, so the link is over.
+ */
+void DatagramTransport::receive()
+{
+  while (waitReadable())
+  {
+    ssize_t received = recv(fd, datagram.data(), datagram.size(), 0);
+    if (received == -1 && errno == EINTR)
+    {
+      continue;
+    }
+    if (received == -1)
+    {
+      return;
+    }
+    if (received > 1 && datagram[0] == TRANSPORT_TEXT)
+    {
+      onMessage(string(datagram.data() + 1, received - 1));
+    }
+  }
+}
@@ -1,10 +1,18 @@
 #include "animation.h"
+#include "cAPA102.h"
 #include "state_handler.h"
 #include "verbose.h"
 
+#include <poll.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#define NO_STATE -1
+
 extern RUNTIME_OPTIONS RUNTIME;
 
-static void *(*state_functions[STATE_NUM])() = {
+static ANIMATION state_functions[STATE_NUM] = {
     on_idle,
     on_listen,
     on_speak,
@@ -12,20 +20,331 @@ static void *(*state_functions[STATE_NUM])() = {
     to_unmute,
     on_disabled};
 
-void state_machine_update(void)
+/* Single slot mailbox: only the latest requested state matters */
+static atomic_int pending_state = NO_STATE;
+static atomic_llong posted_time_us = 0;
+
+/* Latest value slot for direction of arrival, read by the indicator on every frame */
+static atomic_int latest_direction = -1;
+
+/* Settings from a config reload, applied by the render thread between frames */
+static _Atomic(LED_SETTINGS *) pending_settings = NULL;
+
+static atomic_int is_running = 0;
+static atomic_int is_waiting = 0;
+static int wakeup_fd = -1;
+static int timer_fd = -1;
+static int64_t frame_period_us = 1000000 / DEFAULT_FRAME_RATE;
+
+/* Time from a state change request till its first frame is on the LEDs */
+static uint64_t state_changes = 0;
+static uint64_t frames = 0;
+static int64_t latency_sum_us = 0;
+static int64_t latency_max_us = 0;
+
+/* How late frames are rendered relative to their deadlines */
+static uint64_t timed_frames = 0;
+static uint64_t wakeups = 0;
+static int64_t jitter_sum_us = 0;
+static int64_t jitter_max_us = 0;
+static int64_t started_us = 0;
+
+static int64_t get_time_us(void);
+static ANIMATION start_animation(STATE state, ANIMATION_CTX *ctx);
+static int apply_settings(void);
+static void free_settings(LED_SETTINGS *settings);
+static void close_fds(void);
+static void *render_frames(void *arg);
+
+int state_machine_start(void)
+{
+    if (RUNTIME.frame_rate > 0)
+        frame_period_us = 1000000 / RUNTIME.frame_rate;
+
+    wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (-1 == wakeup_fd || -1 == timer_fd)
+    {
+        close_fds();
+        return -1;
+    }
+
+    started_us = get_time_us();
+    atomic_store(&is_running, 1);
+    if (pthread_create(&RUNTIME.render_thread, NULL, render_frames, NULL))
+    {
+        atomic_store(&is_running, 0);
+        close_fds();
+        return -1;
+    }
+    return 0;
+}
+
+void state_machine_post(STATE state)
+{
+    atomic_store(&posted_time_us, get_time_us());
+    atomic_store(&pending_state, state);
+
+    /* Only poke the render thread when it sleeps: a non-blocking eventfd write */
+    if (atomic_load(&is_waiting))
+    {
+        uint64_t value = 1;
+        write(wakeup_fd, &value, sizeof(value));
+    }
+}
+
+void state_machine_post_direction(int degrees)
+{
+    atomic_store_explicit(&latest_direction, degrees, memory_order_relaxed);
+}
+
+void state_machine_post_settings(LED_SETTINGS *settings)
+{
+    free_settings(atomic_exchange(&pending_settings, settings));
+
+    if (atomic_load(&is_waiting))
+    {
+        uint64_t value = 1;
+        write(wakeup_fd, &value, sizeof(value));
+    }
+}
+
+int state_machine_direction(void)
+{
+    return atomic_load_explicit(&latest_direction, memory_order_relaxed);
+}
+
+void state_machine_stop(void)
+{
+    uint64_t value = 1;
+    cAPA102_Stats spi;
+
+    if (!atomic_exchange(&is_running, 0))
+        return;
+
+    write(wakeup_fd, &value, sizeof(value));
+    pthread_join(RUNTIME.render_thread, NULL);
+    close_fds();
+    free_settings(atomic_exchange(&pending_settings, NULL));
+
+    if (state_changes)
+        verbose(VV_INFO, stdout, "LEDs: %llu state changes, %llu frames, state change to first frame = %lld us avg, %lld us max",
+                (unsigned long long)state_changes, (unsigned long long)frames,
+                (long long)(latency_sum_us / (int64_t)state_changes), (long long)latency_max_us);
+    if (timed_frames)
+        verbose(VV_INFO, stdout, "LEDs: %.1f wakeups/s, frame jitter = %lld us avg, %lld us max",
+                wakeups * 1e6 / (get_time_us() - started_us),
+                (long long)(jitter_sum_us / (int64_t)timed_frames), (long long)jitter_max_us);
+
+    cAPA102_Get_Stats(&spi);
+    if (spi.seconds > 0)
+        verbose(VV_INFO, stdout, "SPI: %.1f transfers/s, %.0f bytes/s, %llu unchanged frames skipped",
+                spi.transfers / spi.seconds, spi.bytes / spi.seconds, (unsigned long long)spi.skipped);
+}
+
+static void free_settings(LED_SETTINGS *settings)
+{
+    int state;
+    if (NULL == settings)
+        return;
+    for (state = 0; state < STATE_NUM; state++)
+        free_keyframes(settings->keyframes[state]);
+    free(settings);
+}
+
+static void close_fds(void)
+{
+    if (-1 != wakeup_fd)
+        close(wakeup_fd);
+    if (-1 != timer_fd)
+        close(timer_fd);
+    wakeup_fd = -1;
+    timer_fd = -1;
+}
+
+static int64_t get_time_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * @brief: Pick an animation for the state: disabled, loaded from config or a built-in one.
+ */
+static ANIMATION start_animation(STATE state, ANIMATION_CTX *ctx)
 {
-    void *ret_val = "NONE";
+    memset(ctx, 0, sizeof(*ctx));
+    RUNTIME.curr_state = state;
 
-    if (RUNTIME.animation_enable[RUNTIME.curr_state])
+    if (ON_LISTEN == state && RUNTIME.doa_indicator)
+        return on_direction;
+
+    if (!RUNTIME.animation_enable[state])
+        return on_disabled;
+
+    if (RUNTIME.keyframes[state])
     {
-        verbose(VVV_DEBUG, stdout, "State is changed to %d", RUNTIME.curr_state);
-        // block until the previous terminate
-        pthread_join(RUNTIME.curr_thread, &ret_val);
-        verbose(VVV_DEBUG, stdout, "Previous thread " PURPLE "%s" NONE " terminated with success", (char *)ret_val);
-        pthread_create(&RUNTIME.curr_thread, NULL, state_functions[RUNTIME.curr_state], NULL);
+        verbose(VVV_DEBUG, stdout, PURPLE "[keyframes]" NONE " animation of state %d started", state);
+        ctx->keyframes = RUNTIME.keyframes[state];
+        return play_keyframes;
     }
-    else
+    return state_functions[state];
+}
+
+/**
+ * @brief: Take over settings posted by a config reload, if any. Colour tables are only rebuilt here, so frames never mix them.
+ *         Keyframe tables are swapped here too: the current animation is restarted right after, so nothing plays the old ones.
+ *
+ * @returns: 1\ When settings are changed
+ *           0\ Otherwise
+ */
+static int apply_settings(void)
+{
+    LED_SETTINGS *settings = atomic_exchange(&pending_settings, NULL);
+    KEYFRAME_ANIMATION *previous;
+    int state;
+    if (NULL == settings)
+        return 0;
+
+    RUNTIME.max_brightness = settings->max_brightness;
+    RUNTIME.animation_color = settings->animation_color;
+    memcpy(RUNTIME.animation_enable, settings->animation_enable, sizeof(RUNTIME.animation_enable));
+    RUNTIME.doa_indicator = settings->doa_indicator;
+    RUNTIME.doa_smoothing = settings->doa_smoothing;
+    for (state = 0; state < STATE_NUM; state++)
     {
-        RUNTIME.if_update = 0;
+        previous = RUNTIME.keyframes[state];
+        RUNTIME.keyframes[state] = settings->keyframes[state];
+        settings->keyframes[state] = previous;
     }
+    free_settings(settings);
+
+    build_colour_luts();
+    verbose(VVV_DEBUG, stdout, "LED settings are updated");
+    return 1;
+}
+
+/**
+ * @brief: Arm the frame timer for an absolute deadline, or disarm it when deadline is negative.
+ */
+static void arm_timer(int64_t deadline_us)
+{
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (deadline_us >= 0)
+    {
+        /* Zero means disarm, so the earliest deadline is 1 ns */
+        spec.it_value.tv_sec = deadline_us / 1000000;
+        spec.it_value.tv_nsec = (deadline_us % 1000000) * 1000 + 1;
+    }
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+/**
+ * @brief: Next frame's deadline: the animation's delay after the previous deadline, so timing errors don't accumulate.
+ *         Frame rate only caps how often frames go out: shorter delays are stretched to a frame period.
+ */
+static int64_t next_deadline(int64_t deadline_us, int64_t now_us, int delay_ms)
+{
+    int64_t delay_us = (int64_t)delay_ms * 1000;
+    deadline_us += delay_us > frame_period_us ? delay_us : frame_period_us;
+
+    /* Don't try to catch up after a stall */
+    if (deadline_us < now_us - frame_period_us)
+        deadline_us = now_us;
+    return deadline_us;
+}
+
+/**
+ * @brief: Render thread's loop: run the current animation's frame generator until a new state is requested.
+ *         The thread only wakes up on a frame deadline or a state change.
+ */
+static void *render_frames(void *arg)
+{
+    (void)arg;
+    struct pollfd fds[2] = {{wakeup_fd, POLLIN, 0}, {timer_fd, POLLIN, 0}};
+    ANIMATION_CTX ctx;
+    ANIMATION animation = NULL;
+    int64_t deadline_us = -1, armed_us = -1, posted_us = 0, now_us, jitter_us;
+    int state, delay, is_first_frame = 0;
+    uint64_t value;
+
+    while (atomic_load(&is_running))
+    {
+        state = atomic_exchange(&pending_state, NO_STATE);
+        if (apply_settings() && NO_STATE == state && animation)
+        {
+            animation = start_animation(RUNTIME.curr_state, &ctx);
+            deadline_us = get_time_us();
+        }
+
+        if (NO_STATE != state)
+        {
+            verbose(VVV_DEBUG, stdout, "State is changed to %d", state);
+            posted_us = atomic_load(&posted_time_us);
+            is_first_frame = 1;
+            animation = start_animation((STATE)state, &ctx);
+            deadline_us = get_time_us();
+        }
+
+        now_us = get_time_us();
+        if (animation && deadline_us >= 0 && now_us >= deadline_us)
+        {
+            if (!is_first_frame)
+            {
+                jitter_us = now_us - deadline_us;
+                timed_frames++;
+                jitter_sum_us += jitter_us;
+                if (jitter_us > jitter_max_us)
+                    jitter_max_us = jitter_us;
+            }
+
+            delay = animation(&ctx);
+            now_us = get_time_us();
+            frames++;
+
+            if (is_first_frame)
+            {
+                is_first_frame = 0;
+                state_changes++;
+                latency_sum_us += now_us - posted_us;
+                if (now_us - posted_us > latency_max_us)
+                    latency_max_us = now_us - posted_us;
+                verbose(VVV_DEBUG, stdout, "First frame of state %d is rendered in %lld us", RUNTIME.curr_state, (long long)(now_us - posted_us));
+            }
+
+            if (ANIMATION_DONE == delay)
+            {
+                /* Transitions end up idle, unless something else is already requested */
+                animation = start_animation(ON_IDLE, &ctx);
+                deadline_us = now_us;
+            }
+            else if (ANIMATION_WAIT == delay)
+                deadline_us = -1;
+            else
+                deadline_us = next_deadline(deadline_us, now_us, delay);
+            continue;
+        }
+
+        if (deadline_us != armed_us)
+        {
+            arm_timer(deadline_us);
+            armed_us = deadline_us;
+        }
+
+        atomic_store(&is_waiting, 1);
+        /* Re-check after announcing the wait, so a concurrent request can't be missed */
+        if (NO_STATE == atomic_load(&pending_state) && NULL == atomic_load(&pending_settings) && atomic_load(&is_running))
+        {
+            poll(fds, 2, -1);
+            wakeups++;
+        }
+        atomic_store(&is_waiting, 0);
+        read(wakeup_fd, &value, sizeof(value));
+        read(timer_fd, &value, sizeof(value));
+    }
+
+    cAPA102_Clear_All();
+    return NULL;
 }
@@ -0,0 +1,175 @@
+#include "transcript_publisher.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+extern "C"
+{
+#include "verbose.h"
+}
+
+TranscriptPublisher::TranscriptPublisher(const string &path) : path(path), listenFd(-1)
+{
+}
+
+TranscriptPublisher::~TranscriptPublisher()
+{
+  close();
+}
+
+bool TranscriptPublisher::open()
+{
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+  listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listenFd == -1)
+  {
+    return false;
+  }
+
+  // A socket left by a previous run would fail the bind, but anything else at the path isn't ours to remove.
+  struct stat node;
+  if (lstat(path.c_str(), &node) == 0)
+  {
+    if (!S_ISSOCK(node.st_mode))
+    {
+      verbose(V_NORMAL, stderr, "Unable to listen for transcript consumers on %s: it exists and isn't a socket", path.c_str());
+      ::close(listenFd);
+      listenFd = -1;
+      return false;
+    }
+    unlink(path.c_str());
+  }
+  if (bind(listenFd, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(listenFd, TRANSCRIPT_BACKLOG) == -1)
+  {
+    verbose(V_NORMAL, stderr, "Unable to listen for transcript consumers on %s: %s", path.c_str(), strerror(errno));
+    ::close(listenFd);
+    listenFd = -1;
+    return false;
+  }
+
+  verbose(VV_INFO, stdout, "Transcripts are published on %s", path.c_str());
+  return true;
+}
+
+void TranscriptPublisher::close()
+{
+  for (int consumer : consumers)
+  {
+    ::close(consumer);
+  }
+  consumers.clear();
+
+  if (listenFd != -1)
+  {
+    ::close(listenFd);
+    unlink(path.c_str());
+    listenFd = -1;
+  }
+}
+
+void TranscriptPublisher::publishPartial(uint32_t utterance, int direction, const string &partial)
+{
+  beginFrame(TRANSCRIPT_PARTIAL, utterance, direction);
+  appendText(partial);
+  broadcast();
+}
+
+void TranscriptPublisher::publishFinal(uint32_t utterance, int direction, const AsrResponse &response)
+{
+  beginFrame(TRANSCRIPT_FINAL, utterance, direction);
+  appendText(response.text);
+  appendInt(response.words.size(), 2);
+  for (const AsrWord &word : response.words)
+  {
+    appendFloat(word.start);
+    appendFloat(word.end);
+    appendFloat(word.confidence);
+    appendText(word.word);
+  }
+  broadcast();
+}
+
+/**
+ * Consumers are only accepted when there's something to send them, so no thread is needed to wait for them.
+ */
+void TranscriptPublisher::acceptConsumers()
+{
+  int consumer;
+  while ((consumer = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+  {
+    int sendBuffer = TRANSCRIPT_SEND_BUFFER;
+    setsockopt(consumer, SOL_SOCKET, SO_SNDBUF, &sendBuffer, sizeof(sendBuffer));
+    consumers.push_back(consumer);
+    verbose(VVV_DEBUG, stdout, "Transcript consumer is connected, %zu in total", consumers.size());
+  }
+}
+
+void TranscriptPublisher::beginFrame(TranscriptEventType type, uint32_t utterance, int direction)
+{
+  frame.clear();
+  appendInt(0, 4);
+  appendInt(type, 1);
+  appendInt(utterance, 4);
+  appendInt((uint16_t)(int16_t)direction, 2);
+}
+
+void TranscriptPublisher::appendInt(uint32_t value, int bytes)
+{
+  for (int i = 0; i < bytes; i++)
+  {
+    frame.push_back((char)(value >> (i * 8)));
+  }
+}
+
+void TranscriptPublisher::appendFloat(double value)
+{
+  float single = (float)value;
+  uint32_t bits;
+  memcpy(&bits, &single, sizeof(bits));
+  appendInt(bits, 4);
+}
+
+void TranscriptPublisher::appendText(const string &text)
+{
+  size_t length = min(text.size(), (size_t)UINT16_MAX);
+  appendInt(length, 2);
+  frame.append(text, 0, length);
+}
+
+void TranscriptPublisher::broadcast()
+{
+  uint32_t length = frame.size() - 4;
+  for (int i = 0; i < 4; i++)
+  {
+    frame[i] = (char)(length >> (i * 8));
+  }
+
+  if (listenFd == -1)
+  {
+    return;
+  }
+  acceptConsumers();
+
+  // A partly written frame would break the stream, so a consumer which is that far behind is dropped.
+  for (size_t i = 0; i < consumers.size();)
+  {
+    if (send(consumers[i], frame.data(), frame.size(), MSG_DONTWAIT | MSG_NOSIGNAL) == (ssize_t)frame.size())
+    {
+      i++;
+      continue;
+    }
+    verbose(VVV_DEBUG, stdout, "Transcript consumer is disconnected");
+    ::close(consumers[i]);
+    consumers.erase(consumers.begin() + i);
+  }
+}
@@ -0,0 +1,87 @@
+#include "transport.hpp"
+#include "socket_transport.hpp"
+#include "websocket_transport.hpp"
+
+#include <cstdlib>
+
+extern "C"
+{
+#include "verbose.h"
+}
+
+/**
+ * Only the parts each scheme needs are checked: host and port for network sockets, path for Unix domain sockets.
+ */
+bool TransportAddress::parse(const string &url, TransportAddress &address)
+{
+  size_t schemeEnd = url.find("://");
+  if (schemeEnd == string::npos)
+  {
+    return false;
+  }
+  address.scheme = url.substr(0, schemeEnd);
+  address.host.clear();
+  address.port = 0;
+  address.path.clear();
+
+  string rest = url.substr(schemeEnd + 3);
+  if (address.scheme == "unix")
+  {
+    address.path = rest;
+    return !rest.empty();
+  }
+  if (address.scheme != "ws" && address.scheme != "wss" && address.scheme != "tcp" && address.scheme != "udp")
+  {
+    return false;
+  }
+
+  size_t pathStart = rest.find('/');
+  if (pathStart != string::npos)
+  {
+    address.path = rest.substr(pathStart);
+    rest.erase(pathStart);
+  }
+
+  // IPv6 addresses come in brackets: [::1]:2700.
+  size_t hostEnd = rest[0] == '[' ? rest.find(']') : rest.rfind(':');
+  size_t portStart = hostEnd == string::npos ? string::npos : rest.find(':', hostEnd);
+  if (hostEnd == string::npos || portStart == string::npos)
+  {
+    // Port is optional for WS only.
+    address.host = rest;
+    address.port = address.scheme == "wss" ? 443 : 80;
+    return !rest.empty() && rest[0] != '[' && (address.scheme == "ws" || address.scheme == "wss");
+  }
+
+  address.host = rest[0] == '[' ? rest.substr(1, hostEnd - 1) : rest.substr(0, hostEnd);
+  char *end;
+  address.port = strtol(rest.c_str() + portStart + 1, &end, 10);
+  return !address.host.empty() && *end == '\0' && address.port > 0 && address.port < 65536;
+}
+
+void Transport::setCallbacks(function<void()> onOpen, function<void()> onClose, function<void(const string &)> onMessage)
+{
+  this->onOpen = onOpen;
+  this->onClose = onClose;
+  this->onMessage = onMessage;
+}
+
+unique_ptr<Transport> createTransport(const string &url)
+{
+  TransportAddress address;
+  if (!TransportAddress::parse(url, address))
+  {
+    verbose(V_NORMAL, stderr, "Unsupported ASR server address '%s'", url.c_str());
+    return nullptr;
+  }
+
+  if (address.scheme == "tcp" || address.scheme == "unix")
+  {
+    return unique_ptr<Transport>(new StreamTransport(address));
+  }
+  if (address.scheme == "udp")
+  {
+    return unique_ptr<Transport>(new DatagramTransport(address));
+  }
+  return unique_ptr<Transport>(new WebSocketTransport(url));
+}
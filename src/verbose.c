@@ -1,49 +1,329 @@
 #include "verbose.h"
 
+#include <errno.h>
+#include <poll.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
 
-static char *get_time_stamp(void);
+/* Single producer / single consumer ring owned by one thread at a time */
+typedef struct LOG_QUEUE
+{
+    struct
+    {
+        VERBOSE lvl;
+        FILE *stream;
+        int64_t time_ms;
+        char text[LOG_MSG_MAX];
+    } records[LOG_QUEUE_SIZE];
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_int is_owned;
+    struct LOG_QUEUE *next;
+} LOG_QUEUE;
 
 static VERBOSE LEVEL = V_NORMAL;
+static VERBOSE_FORMAT FORMAT = VERBOSE_TEXT;
+
+static _Atomic(LOG_QUEUE *) queues = NULL;
+static _Thread_local LOG_QUEUE *thread_queue = NULL;
+static pthread_key_t queue_key;
+static pthread_once_t queue_key_once = PTHREAD_ONCE_INIT;
+
+static pthread_t writer;
+static atomic_int is_writer_running = 0;
+static atomic_int is_writer_waiting = 0;
+static atomic_uint dropped = 0;
+static int wakeup_fd = -1;
+
+static int64_t get_time_ms(void);
+static LOG_QUEUE *get_thread_queue(void);
+static void release_queue(void *queue);
+static void create_queue_key(void);
+static int enqueue(VERBOSE lvl, FILE *stream, const char *__restrict format, va_list args);
+static void write_record(VERBOSE lvl, FILE *stream, int64_t time_ms, const char *text);
+static int drain_queues(void);
+static void *write_records(void *arg);
 
 void setVerbose(VERBOSE lvl)
 {
     LEVEL = lvl;
 }
 
+void setVerboseFormat(VERBOSE_FORMAT format)
+{
+    FORMAT = format;
+}
+
 int verbose(VERBOSE lvl, FILE *stream, const char *__restrict format, ...)
 {
     if (lvl > LEVEL)
         return 0;
 
-    char *time_temp = get_time_stamp();
-    char label[50];
+    va_list args;
+    va_start(args, format);
+    int ret = enqueue(lvl, stream, format, args);
+    va_end(args);
+    return ret;
+}
 
-    if (lvl == V_NORMAL)
-        strcpy(label, RED " [Error] " NONE);
-    if (lvl == VV_INFO)
-        strcpy(label, BLUE " [Info] " NONE);
-    if (lvl == VVV_DEBUG)
-        strcpy(label, YELLOW " [Debug] " NONE);
+int verbose_rate_limited(VERBOSE_RATE_LIMIT *limit, int interval_ms, VERBOSE lvl, FILE *stream, const char *__restrict format, ...)
+{
+    if (lvl > LEVEL)
+        return 0;
 
-    fputs(time_temp, stream);
-    fputs(label, stream);
+    int64_t now = get_time_ms();
+    if (limit->last_ms != 0 && now - limit->last_ms < interval_ms)
+    {
+        limit->suppressed++;
+        return 0;
+    }
 
+    char text[LOG_MSG_MAX];
     va_list args;
     va_start(args, format);
-    int ret = vfprintf(stream, format, args);
+    vsnprintf(text, sizeof(text), format, args);
     va_end(args);
-    fputs("\n", stream);
+
+    int ret = limit->suppressed ? verbose(lvl, stream, "%s (%u similar messages suppressed)", text, limit->suppressed)
+                                : verbose(lvl, stream, "%s", text);
+    limit->last_ms = now;
+    limit->suppressed = 0;
+    return ret;
+}
+
+int verbose_start(void)
+{
+    wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (-1 == wakeup_fd)
+        return -1;
+
+    atomic_store(&is_writer_running, 1);
+    if (pthread_create(&writer, NULL, write_records, NULL))
+    {
+        atomic_store(&is_writer_running, 0);
+        close(wakeup_fd);
+        wakeup_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void verbose_stop(void)
+{
+    uint64_t value = 1;
+
+    if (!atomic_exchange(&is_writer_running, 0))
+        return;
+
+    write(wakeup_fd, &value, sizeof(value));
+    pthread_join(writer, NULL);
+    close(wakeup_fd);
+    wakeup_fd = -1;
+}
+
+/**
+ * @brief: Milliseconds since the first call, based on monotonic clock.
+ */
+static int64_t get_time_ms(void)
+{
+    static int64_t start_ms = 0;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t now_ms = (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+    if (0 == start_ms)
+        start_ms = now_ms;
+    return now_ms - start_ms;
+}
+
+static void create_queue_key(void)
+{
+    pthread_key_create(&queue_key, release_queue);
+}
+
+/**
+ * @brief: Hand the queue over to the next thread when its owner exits. Its pending messages are still written out.
+ */
+static void release_queue(void *queue)
+{
+    atomic_store_explicit(&((LOG_QUEUE *)queue)->is_owned, 0, memory_order_release);
+}
+
+/**
+ * @brief: Get calling thread's queue: reuse one released by a finished thread or register a new one.
+ */
+static LOG_QUEUE *get_thread_queue(void)
+{
+    LOG_QUEUE *queue;
+    int expected;
+
+    if (thread_queue)
+        return thread_queue;
+
+    pthread_once(&queue_key_once, create_queue_key);
+
+    for (queue = atomic_load(&queues); queue; queue = queue->next)
+    {
+        expected = 0;
+        if (atomic_compare_exchange_strong(&queue->is_owned, &expected, 1))
+            break;
+    }
+
+    if (!queue)
+    {
+        queue = (LOG_QUEUE *)calloc(1, sizeof(LOG_QUEUE));
+        if (!queue)
+            return NULL;
+        atomic_init(&queue->is_owned, 1);
+        queue->next = atomic_load(&queues);
+        while (!atomic_compare_exchange_weak(&queues, &queue->next, queue))
+            ;
+    }
+
+    pthread_setspecific(queue_key, queue);
+    thread_queue = queue;
+    return queue;
+}
+
+static int enqueue(VERBOSE lvl, FILE *stream, const char *__restrict format, va_list args)
+{
+    LOG_QUEUE *queue;
+    unsigned int tail, head;
+    int64_t time_ms = get_time_ms();
+    int ret;
+
+    if (!atomic_load(&is_writer_running) || !(queue = get_thread_queue()))
+    {
+        char text[LOG_MSG_MAX];
+        ret = vsnprintf(text, sizeof(text), format, args);
+        write_record(lvl, stream, time_ms, text);
+        return ret;
+    }
+
+    tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (tail - head >= LOG_QUEUE_SIZE)
+    {
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        return 0;
+    }
+
+    ret = vsnprintf(queue->records[tail % LOG_QUEUE_SIZE].text, LOG_MSG_MAX, format, args);
+    queue->records[tail % LOG_QUEUE_SIZE].lvl = lvl;
+    queue->records[tail % LOG_QUEUE_SIZE].stream = stream;
+    queue->records[tail % LOG_QUEUE_SIZE].time_ms = time_ms;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_seq_cst);
+
+    /* Only poke the writer when it sleeps: a non-blocking eventfd write */
+    if (atomic_load(&is_writer_waiting))
+    {
+        uint64_t value = 1;
+        write(wakeup_fd, &value, sizeof(value));
+    }
     return ret;
 }
 
-static char *get_time_stamp(void)
+static void write_json_string(FILE *stream, const char *text)
 {
-    static char c_time[50];
-    time_t tmpcal_ptr;
-    struct tm *tmp_ptr = NULL;
-    time(&tmpcal_ptr);
-    tmp_ptr = gmtime(&tmpcal_ptr);
-    sprintf(c_time, GREEN "[%02d:%02d:%02d]" NONE, tmp_ptr->tm_hour, tmp_ptr->tm_min, tmp_ptr->tm_sec);
-    return c_time;
+    fputc('"', stream);
+    for (; *text; text++)
+    {
+        /* Colours make no sense in JSON */
+        if ('\033' == *text)
+        {
+            while (*text && 'm' != *text)
+                text++;
+            if (!*text)
+                break;
+        }
+        else if ('"' == *text || '\\' == *text)
+        {
+            fputc('\\', stream);
+            fputc(*text, stream);
+        }
+        else if ((unsigned char)*text < 0x20)
+            fprintf(stream, "\\u%04x", *text);
+        else
+            fputc(*text, stream);
+    }
+    fputc('"', stream);
+}
+
+static void write_record(VERBOSE lvl, FILE *stream, int64_t time_ms, const char *text)
+{
+    static const char *labels[] = {RED " [Error] " NONE, BLUE " [Info] " NONE, YELLOW " [Debug] " NONE};
+    static const char *levels[] = {"error", "info", "debug"};
+
+    if (VERBOSE_JSON == FORMAT)
+    {
+        fprintf(stream, "{\"time\":%lld.%03d,\"level\":\"%s\",\"message\":", (long long)(time_ms / 1000), (int)(time_ms % 1000), levels[lvl]);
+        write_json_string(stream, text);
+        fputs("}\n", stream);
+    }
+    else
+    {
+        fprintf(stream, GREEN "[%6lld.%03d]" NONE "%s%s\n", (long long)(time_ms / 1000), (int)(time_ms % 1000), labels[lvl], text);
+    }
+}
+
+/**
+ * @brief: Write out everything queued so far.
+ *
+ * @returns: Number of written records
+ */
+static int drain_queues(void)
+{
+    LOG_QUEUE *queue;
+    unsigned int head, tail, lost;
+    int written = 0;
+
+    for (queue = atomic_load(&queues); queue; queue = queue->next)
+    {
+        head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+        tail = atomic_load(&queue->tail);
+        for (; head != tail; head++, written++)
+            write_record(queue->records[head % LOG_QUEUE_SIZE].lvl,
+                         queue->records[head % LOG_QUEUE_SIZE].stream,
+                         queue->records[head % LOG_QUEUE_SIZE].time_ms,
+                         queue->records[head % LOG_QUEUE_SIZE].text);
+        atomic_store_explicit(&queue->head, head, memory_order_release);
+    }
+
+    lost = atomic_exchange(&dropped, 0);
+    if (lost)
+    {
+        char text[LOG_MSG_MAX];
+        snprintf(text, sizeof(text), "%u log messages were dropped", lost);
+        write_record(V_NORMAL, stderr, get_time_ms(), text);
+    }
+
+    if (written)
+    {
+        fflush(stdout);
+        fflush(stderr);
+    }
+    return written;
+}
+
+static void *write_records(void *arg)
+{
+    (void)arg;
+    struct pollfd wakeup = {wakeup_fd, POLLIN, 0};
+    uint64_t value;
+
+    while (atomic_load(&is_writer_running))
+    {
+        if (drain_queues())
+            continue;
+
+        atomic_store(&is_writer_waiting, 1);
+        /* Re-check after announcing the wait, so a concurrent message can't be missed */
+        if (!drain_queues())
+            poll(&wakeup, 1, LOG_WRITER_TIMEOUT_MS);
+        atomic_store(&is_writer_waiting, 0);
+        read(wakeup_fd, &value, sizeof(value));
+    }
+
+    drain_queues();
+    return NULL;
 }
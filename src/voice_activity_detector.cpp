@@ -0,0 +1,83 @@
+#include "voice_activity_detector.hpp"
+
+#include <cmath>
+#include <cstdint>
+
+VoiceActivityDetector::VoiceActivityDetector(double threshold, int trailingSilence, int blockMs)
+{
+  this->threshold = threshold;
+  this->trailingSilence = trailingSilence;
+  this->blockMs = blockMs;
+  noiseFloor = 0;
+  isFloorKnown = false;
+  reset();
+}
+
+/**
+ * Classify a block as speech or silence. Called for every block, so that noise floor is tracked while idle too.
+ */
+bool VoiceActivityDetector::process(const AudioChunk &chunk)
+{
+  const int16_t *samples = (const int16_t *)chunk.data.data();
+  size_t count = chunk.data.size() / sizeof(int16_t);
+  if (count == 0)
+  {
+    return false;
+  }
+
+  double energy = 0;
+  for (size_t i = 0; i < count; i++)
+  {
+    energy += (double)samples[i] * samples[i];
+  }
+  double level = 10 * log10(energy / count + 1);
+
+  // Floor follows quiet blocks fast and loud ones slowly, so speech barely moves it.
+  if (!isFloorKnown)
+  {
+    noiseFloor = level;
+    isFloorKnown = true;
+  }
+  noiseFloor += (level - noiseFloor) * (level < noiseFloor ? VAD_FLOOR_FALL : VAD_FLOOR_RISE);
+
+  bool isSpeech = level > VAD_MIN_LEVEL_DB && level > noiseFloor + threshold;
+  if (isSpeech)
+  {
+    speechMs += blockMs;
+    silenceMs = 0;
+    // Ignore short clicks.
+    if (speechMs >= VAD_MIN_SPEECH_MS)
+    {
+      hasSpeech = true;
+    }
+    speechEndTime = chunk.captureTime;
+  }
+  else
+  {
+    speechMs = 0;
+    silenceMs += blockMs;
+  }
+
+  return isSpeech;
+}
+
+/**
+ * Forget the current utterance (noise floor is kept).
+ */
+void VoiceActivityDetector::reset()
+{
+  speechMs = 0;
+  silenceMs = 0;
+  hasSpeech = false;
+  speechEndTime = SteadyClock::now();
+}
+
+bool VoiceActivityDetector::isUtteranceEnded()
+{
+  return hasSpeech && silenceMs >= trailingSilence;
+}
+
+TimePoint VoiceActivityDetector::lastSpeechTime()
+{
+  return speechEndTime;
+}
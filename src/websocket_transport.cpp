@@ -0,0 +1,51 @@
+#include "websocket_transport.hpp"
+
+WebSocketTransport::WebSocketTransport(const string &url) : url(url)
+{
+  client.setUrl(url);
+  client.setPingInterval(WS_PING_INTERVAL);
+  client.disablePerMessageDeflate();
+  // Reconnection is driven by the ASR client, which knows what has to be replayed.
+  client.disableAutomaticReconnection();
+  client.setOnMessageCallback([this](const ix::WebSocketMessagePtr &msg) {
+    auto type = msg->type;
+
+    if (type == ix::WebSocketMessageType::Message)
+    {
+      this->onMessage(msg->str);
+    }
+    else if (type == ix::WebSocketMessageType::Open)
+    {
+      this->onOpen();
+    }
+    else if (type == ix::WebSocketMessageType::Close)
+    {
+      this->onClose();
+    }
+  });
+}
+
+string WebSocketTransport::name()
+{
+  return "WebSocket";
+}
+
+void WebSocketTransport::start()
+{
+  client.start();
+}
+
+void WebSocketTransport::stop()
+{
+  client.stop();
+}
+
+bool WebSocketTransport::sendBinary(const string &payload)
+{
+  return client.sendBinary(payload).success;
+}
+
+bool WebSocketTransport::sendText(const string &text)
+{
+  return client.sendText(text).success;
+}